@@ -28,6 +28,9 @@
 #include "ns3/building-allocator.h"
 #include "ns3/buildings-helper.h"
 #include "ns3/forwarder-helper.h"
+#include "ns3/config.h"
+#include "ns3/boolean.h"
+#include "ns3/enum.h"
 #include "ns3/gnuplot.h"
 #include <algorithm>
 #include <ctime>
@@ -35,6 +38,21 @@
  
 #include "ns3/gnuplot.h"
 
+#include "static-position-store.h"
+#include "link-budget.h"
+#include "device-hibernation.h"
+#include "network-server-monitor.h"
+#include "direct-forwarder.h"
+#include "lorawan-logging.h"
+#include "event-ring-log.h"
+#include "common-random-numbers.h"
+#include "phase-profiler.h"
+#include "incremental-adr-component.h"
+#include "telemetry-exporter.h"
+#include "heap-accounting.h"
+#include "results-report.h"
+#include "capacity-surrogate.h"
+
 using namespace ns3;
 using namespace lorawan;
 
@@ -51,6 +69,43 @@ bool realisticChannelModel = false;
 
 int appPeriodSeconds = 1800;
 
+// Skip the events of devices that no gateway can hear
+bool hibernate = false;
+
+// Backhaul: hand uplinks straight to the network server instead of using
+// point-to-point links
+bool directBackhaul = false;
+double backhaulDelay = 0.002;
+
+// Pin random streams to sites and roles, for comparing variants
+bool commonRandomNumbers = false;
+
+// Adapt data rates and transmission powers from the network server
+bool adr = false;
+
+// Ask for an ACK to every uplink
+bool confirmed = false;
+
+// Diagnostics
+std::string logLevel = "none";
+bool nsUplinks = false;
+std::string eventLog = "";
+bool eventLogLastOnly = false;
+std::string profile = "";
+std::string telemetry = "";
+double telemetryPeriod = 10;
+std::string heapReport = "";
+double heapReportPeriod = 3600;
+std::string report = "";
+double reportBucket = 3600;
+
+// Analytical estimate of the outcomes: off, only, sweep or compare
+std::string surrogate = "off";
+uint32_t surrogateChannels = 3;
+double surrogateDutyCycle = 0.01;
+std::string surrogatePeriods = "60,600,3600";
+std::string surrogateScales = "0.5,1,2";
+
 // Output control
 bool print = true;
 
@@ -150,34 +205,81 @@ main (int argc, char *argv[])
                 "The period in seconds to be used by periodically transmitting applications",
                 appPeriodSeconds);
   cmd.AddValue ("print", "Whether or not to print various informations", print);
+  cmd.AddValue ("hibernate",
+                "Account packets of devices below every gateway's sensitivity as lost "
+                "instead of simulating them (their packets then add no interference)",
+                hibernate);
+  cmd.AddValue ("directBackhaul",
+                "Deliver uplinks from the gateways to the network server in-process",
+                directBackhaul);
+  cmd.AddValue ("backhaulDelay", "Gateway to network server delay in seconds with directBackhaul",
+                backhaulDelay);
+  cmd.AddValue ("crn",
+                "Draw each device's and module's randomness from a stream named after its "
+                "site or role (common random numbers)",
+                commonRandomNumbers);
+  cmd.AddValue ("adr", "Enable ADR, with constant work per uplink at the network server",
+                adr);
+  cmd.AddValue ("confirmed",
+                "Send confirmed uplinks, which the network server answers in RX1 or RX2",
+                confirmed);
+  cmd.AddValue ("nsUplinks",
+                "Count the distinct uplinks and gateway copies the network server receives "
+                "(extra work for every copy)",
+                nsUplinks);
+  cmd.AddValue ("logLevel",
+                "Log level of the lorawan components: none, error, warn, debug, info, "
+                "function, logic or all",
+                logLevel);
+  cmd.AddValue ("eventLog", "File to write the binary PHY/MAC event log to", eventLog);
+  cmd.AddValue ("eventLogLastOnly", "Only keep the last events in the event log",
+                eventLogLastOnly);
+  cmd.AddValue ("profile",
+                "JSON file to write the wall time, RSS and hardware counters of each "
+                "phase to",
+                profile);
+  cmd.AddValue ("telemetry",
+                "Prometheus text file to rewrite with the progress of the run (its event count "
+                "leaves out the exporter's own sampling event, once per simulated second)",
+                telemetry);
+  cmd.AddValue ("telemetryPeriod", "Wall clock seconds between two telemetry updates",
+                telemetryPeriod);
+  cmd.AddValue ("heapReport",
+                "File to write live and peak heap bytes per component to (needs a build "
+                "with -DAREA_HEAP_ACCOUNTING)",
+                heapReport);
+  cmd.AddValue ("heapReportPeriod", "Simulated seconds between two heap reports",
+                heapReportPeriod);
+  cmd.AddValue ("report",
+                "Prefix of the CSV files of outcomes per gateway, device, SF and time "
+                "bucket",
+                report);
+  cmd.AddValue ("reportBucket", "Width in seconds of the time buckets of the report",
+                reportBucket);
+  cmd.AddValue ("surrogate",
+                "Analytical estimate of the outcomes: off, only (print it and skip the "
+                "simulation), sweep (print it for surrogatePeriods x surrogateScales and "
+                "skip the simulation) or compare (print it next to the simulated outcomes)",
+                surrogate);
+  cmd.AddValue ("surrogateChannels", "Uplink channels of the estimate", surrogateChannels);
+  cmd.AddValue ("surrogateDutyCycle", "Sub-band duty cycle of the estimate", surrogateDutyCycle);
+  cmd.AddValue ("surrogatePeriods", "Application periods in seconds swept by the estimate",
+                surrogatePeriods);
+  cmd.AddValue ("surrogateScales", "Device densities, relative to nDevices, swept by the estimate",
+                surrogateScales);
   cmd.Parse (argc, argv);
 
-  // Set up logging
-  //LogComponentEnable ("ComplexLorawanNetworkExample", LOG_LEVEL_INFO);
-  //LogComponentEnable ("LoraPacketTracker", LOG_LEVEL_INFO);
-  // LogComponentEnable("LoraChannel", LOG_LEVEL_INFO);
-  // LogComponentEnable("LoraPhy", LOG_LEVEL_ALL);
-  // LogComponentEnable("EndDeviceLoraPhy", LOG_LEVEL_ALL);
-  // LogComponentEnable("GatewayLoraPhy", LOG_LEVEL_ALL);
-  // LogComponentEnable("LoraInterferenceHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("LorawanMac", LOG_LEVEL_ALL);
-  // LogComponentEnable("EndDeviceLorawanMac", LOG_LEVEL_ALL);
-  // LogComponentEnable("ClassAEndDeviceLorawanMac", LOG_LEVEL_ALL);
-  // LogComponentEnable("GatewayLorawanMac", LOG_LEVEL_ALL);
-  // LogComponentEnable("LogicalLoraChannelHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("LogicalLoraChannel", LOG_LEVEL_ALL);
-  // LogComponentEnable("LoraHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("LoraPhyHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("LorawanMacHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("PeriodicSenderHelper", LOG_LEVEL_ALL);
-  // LogComponentEnable("PeriodicSender", LOG_LEVEL_ALL);
-  // LogComponentEnable("LorawanMacHeader", LOG_LEVEL_ALL);
-  // LogComponentEnable("LoraFrameHeader", LOG_LEVEL_ALL);
-  // LogComponentEnable("NetworkScheduler", LOG_LEVEL_ALL);
-  // LogComponentEnable("NetworkServer", LOG_LEVEL_ALL);
-  // LogComponentEnable("NetworkStatus", LOG_LEVEL_ALL);
-  // LogComponentEnable("NetworkController", LOG_LEVEL_ALL);
-  //LogComponentEnable("GatewayLoraPhy", LOG_LEVEL_ALL);
+  // Set up logging, clamped to the compile-time maximum levels of
+  // lorawan-logging.h
+  EnableLorawanLogging (ParseLorawanLogLevel (logLevel));
+
+  // Break the run down into phases, see phase-profiler.h
+  PhaseProfiler profiler;
+  if (!profile.empty ())
+    {
+      profiler.Enable ();
+    }
+  profiler.Begin ("setup");
 
   /***********
    *  Setup  *
@@ -186,6 +288,17 @@ main (int argc, char *argv[])
   // Create the time value from the period
   Time appPeriod = Seconds (appPeriodSeconds);
 
+  // Let the network server control the data rate of the devices
+  if (adr)
+    {
+      Config::SetDefault ("ns3::EndDeviceLorawanMac::DRControl", BooleanValue (true));
+    }
+  if (confirmed)
+    {
+      Config::SetDefault ("ns3::EndDeviceLorawanMac::MType",
+                          EnumValue (LorawanMacHeader::CONFIRMED_DATA_UP));
+    }
+
   // Mobility
   MobilityHelper mobility;
   Ptr<ListPositionAllocator> allocator = CreateObject<ListPositionAllocator> ();
@@ -213,6 +326,9 @@ main (int argc, char *argv[])
   mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
   Create2DPlotFile(allocator);
 
+  profiler.Begin ("channel");
+  HeapAccounting::SetTag (HeapAccounting::CHANNEL);
+
   /************************
    *  Create the channel  *
    ************************/
@@ -258,6 +374,9 @@ main (int argc, char *argv[])
 
   Ptr<LoraChannel> channel = CreateObject<LoraChannel> (loss, delay);
 
+  profiler.Begin ("install");
+  HeapAccounting::SetTag (HeapAccounting::NODES_DEVICES);
+
   /************************
    *  Create the helpers  *
    ************************/
@@ -334,14 +453,63 @@ main (int argc, char *argv[])
 
   
 
+  profiler.Begin ("spreading-factors");
+  HeapAccounting::SetTag (HeapAccounting::UNTAGGED);
+
   /**********************************************
    *  Set up the end device's spreading factor  *
    **********************************************/
 
-  macHelper.SetSpreadingFactorsUp (endDevices, gateways, channel);
+  // Mirror the static positions into contiguous arrays, so the link budget
+  // does not go through the mobility models for every device/gateway pair
+  StaticPositionStore edPositions;
+  edPositions.Add (endDevices);
+  StaticPositionStore gwPositions;
+  gwPositions.Add (gateways);
+
+  // Without shadowing the loss only depends on distance
+  SetSpreadingFactorsUp (edPositions, gwPositions, channel, !realisticChannelModel);
+
+  // Expected outcomes from the same link budget, with the data rates and
+  // powers the devices have now
+  SurrogatePrediction prediction;
+  if (surrogate != "off")
+    {
+      std::vector<uint8_t> dataRates;
+      std::vector<double> txPowers;
+      for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+        {
+          Ptr<EndDeviceLorawanMac> mac = (*i)->GetDevice (0)
+                                             ->GetObject<LoraNetDevice> ()
+                                             ->GetMac ()
+                                             ->GetObject<EndDeviceLorawanMac> ();
+          dataRates.push_back (mac->GetDataRate ());
+          txPowers.push_back (mac->GetTransmissionPower ());
+        }
+      CapacitySurrogate<Eu868Profile, 23> estimator (surrogateChannels, surrogateDutyCycle, 14);
+      estimator.Build (
+          ComputeBestLinks (edPositions, gwPositions, channel, 14, !realisticChannelModel),
+          gateways.GetN (), dataRates, txPowers);
+      if (surrogate == "sweep")
+        {
+          estimator.Sweep (ParseSweepList (surrogatePeriods), ParseSweepList (surrogateScales),
+                           simulationTime, std::cout);
+          return 0;
+        }
+      prediction = estimator.Evaluate (appPeriodSeconds, simulationTime);
+      std::cout << "Surrogate estimate:" << std::endl;
+      prediction.Print (std::cout);
+      if (surrogate == "only")
+        {
+          return 0;
+        }
+    }
 
   NS_LOG_DEBUG ("Completed configuration");
 
+  profiler.Begin ("applications");
+  HeapAccounting::SetTag (HeapAccounting::APPLICATIONS);
+
   /*********************************************
    *  Install applications on the end devices  *
    *********************************************/
@@ -357,8 +525,37 @@ main (int argc, char *argv[])
   appContainer.Start (Seconds (0));
   appContainer.Stop (appStopTime);
 
+  // Make scenario variants share their randomness
+  CommonRandomNumbers crn;
+  std::vector<Time> startDelays;
+  if (commonRandomNumbers)
+    {
+      crn.PinPropagation (loss, delay);
+      startDelays = crn.PinStartTimes (endDevices, appPeriod);
+    }
+
+  // Outcomes per gateway, device, SF and time bucket, counted as they
+  // happen
+  ResultsReport results (endDevices, gateways, Seconds (reportBucket), appStopTime);
+  results.Install ();
+
+  // Devices under every gateway's SF12 sensitivity only produce lost packets
+  DeviceHibernation hibernation (edPositions, gwPositions, channel, !realisticChannelModel);
+  if (hibernate)
+    {
+      hibernation.SetLostPacketCallback (
+          MakeCallback (&ResultsReport::Hibernated, &results));
+      hibernation.SetInitialDelays (startDelays);
+      uint32_t asleep = hibernation.Hibernate (appHelper, appPeriod, 23, appStopTime,
+                                               helper.GetPacketTracker ());
+      std::cout << "Hibernated devices: " << asleep << std::endl;
+    }
+
   PrintDataRate (endDevices, gateways,"scratch/area-depok-jaksel.dat");
 
+  profiler.Begin ("network-server");
+  HeapAccounting::SetTag (HeapAccounting::NETWORK_SERVER);
+
   /**************************
    *  Create Network Server  *
    ***************************/
@@ -372,35 +569,133 @@ main (int argc, char *argv[])
   nsHelper.SetGateways (gateways);
   nsHelper.Install (networkServer);
 
-  //Create a forwarder for each gateway
-  forHelper.Install (gateways);
+  // Count distinct uplinks per device at the network server, folding the
+  // copies forwarded by different gateways within one second
+  Ptr<NetworkServerMonitor> nsMonitor;
+  if (nsUplinks)
+    {
+      nsMonitor = Create<NetworkServerMonitor> (Seconds (1), nDevices / appPeriodSeconds + 1);
+      nsMonitor->SetEndDevices (endDevices);
+      nsMonitor->Install (
+          networkServer.Get (0)->GetApplication (0)->GetObject<NetworkServer> ());
+    }
+
+  Ptr<IncrementalAdrComponent> adrComponent;
+  if (adr)
+    {
+      adrComponent = CreateObject<IncrementalAdrComponent> ();
+      networkServer.Get (0)->GetApplication (0)->GetObject<NetworkServer> ()->AddComponent (
+          adrComponent);
+    }
+
+  if (directBackhaul)
+    {
+      // Hand each received packet to the network server by reference,
+      // without copying it over the point-to-point links
+      DirectForwarderHelper directHelper;
+      directHelper.SetDelay (Seconds (backhaulDelay));
+      directHelper.Install (gateways,
+                            networkServer.Get (0)->GetApplication (0)->GetObject<NetworkServer> ());
+    }
+  else
+    {
+      //Create a forwarder for each gateway
+      forHelper.Install (gateways);
+    }
 
   helper.EnablePeriodicDeviceStatusPrinting(endDevices,gateways,"axaxx1",Seconds (1800));//cek data rate & tx power per ed
   helper.EnablePeriodicPhyPerformancePrinting(gateways,"axaxx2",Seconds (1800)); 
   helper.EnablePeriodicGlobalPerformancePrinting("axaxx3",Seconds (1800));
   //helper.EnableSimulationTimePrinting(Seconds (1800));
 
+  // Compact binary records of every PHY/MAC event, decoded offline by
+  // lora-event-log-decode
+  EventRingLog eventRing;
+  if (!eventLog.empty ())
+    {
+      eventRing.SetOutputFile (eventLog, !eventLogLastOnly);
+      eventRing.Install (endDevices, gateways,
+                         networkServer.Get (0)->GetApplication (0)->GetObject<NetworkServer> ());
+    }
+
+  // Progress of the run, readable while it is going
+  TelemetryExporter telemetryExporter;
+  if (!telemetry.empty ())
+    {
+      telemetryExporter.Install (
+          endDevices, gateways,
+          networkServer.Get (0)->GetApplication (0)->GetObject<NetworkServer> ());
+      telemetryExporter.Start (telemetry, telemetryPeriod);
+    }
+
   ////////////////
   // Simulation //
   ////////////////
 
   Simulator::Stop (appStopTime );
 
+  // Heap per component, charged to the role of the node of each event
+  // while running
+  HeapReport heapReporter;
+  if (!heapReport.empty ())
+    {
+      heapReporter.Start (heapReport, Seconds (heapReportPeriod));
+    }
+  HeapAccounting::SetTag (HeapAccounting::UNTAGGED);
+
   NS_LOG_INFO ("Running simulation...");
+  profiler.Begin ("run");
+  HeapAccounting::BeginRun (endDevices, gateways, networkServer);
   Simulator::Run ();
+  HeapAccounting::EndRun ();
+  telemetryExporter.Stop ();
 
+  profiler.Begin ("destroy");
   Simulator::Destroy ();
 
   ///////////////////////////
   // Print results to file //
   ///////////////////////////
   NS_LOG_INFO ("Computing performance metrics...");
+  profiler.Begin ("report");
+  HeapAccounting::SetTag (HeapAccounting::REPORT);
 
-  LoraPacketTracker &tracker = helper.GetPacketTracker ();
-  //std::cout << tracker.CountMacPacketsGlobally (Seconds (0), appStopTime) << std::endl;
   std::cout << std::endl;
-  std::cout << "SENT RECEIVED INTERFERED NO_MORE_RECEIVERS UNDER_SENSITIVITY LOST_BECAUSE_TX " << std::endl;
-  std::cout << tracker.PrintPhyPacketsPerGw (Seconds (0), appStopTime,gateways.Get(0)->GetId()) << std::endl;
+  std::cout << "GATEWAY SENT RECEIVED INTERFERED NO_MORE_RECEIVERS UNDER_SENSITIVITY LOST_BECAUSE_TX " << std::endl;
+  results.PrintGateways (std::cout);
+  std::cout << "Delivered uplinks: " << results.GetCount (ResultsReport::DELIVERED) << std::endl;
+  if (!report.empty ())
+    {
+      results.WriteCsv (report);
+      std::cout << "Outcome tables written to " << report << "-*.csv" << std::endl;
+    }
+  if (surrogate == "compare")
+    {
+      double simulatedSent[6];
+      double simulatedDelivered[6];
+      for (uint8_t sf = 7; sf <= 12; sf++)
+        {
+          simulatedSent[sf - 7] = results.GetSfCount (sf, ResultsReport::SENT);
+          simulatedDelivered[sf - 7] = results.GetSfCount (sf, ResultsReport::DELIVERED);
+        }
+      prediction.PrintComparison (std::cout, simulatedSent, simulatedDelivered);
+    }
+  if (nsUplinks)
+    {
+      std::cout << "Uplinks at the network server: " << nsMonitor->GetUplinks () << " ("
+                << nsMonitor->GetCopies () << " gateway copies)" << std::endl;
+    }
+  if (adr)
+    {
+      std::cout << "LinkAdrReq commands: " << adrComponent->GetLinkAdrReqs () << std::endl;
+    }
+
+  if (!profile.empty ())
+    {
+      profiler.WriteJson (profile);
+      std::cout << "Phase profile written to " << profile << std::endl;
+    }
+  heapReporter.Write (appStopTime.GetSeconds ());
   
   return 0;
 }
@@ -0,0 +1,401 @@
+/*
+ * Duty cycle and channel availability of a device, for large channel
+ * plans.
+ *
+ * LogicalLoraChannelHelper keeps sub-bands and channels in lists: every
+ * uplink builds the list of enabled channels, and for each of them finds
+ * its sub-band by walking the sub-band list to get its waiting time, so a
+ * send costs O(channels x sub-bands). That is fine for the 1 to 8
+ * channels of the regional defaults, less so for 16 and 64 channel custom
+ * plans split into many sub-bands.
+ *
+ * Here the sub-band of each channel is resolved once when the channel is
+ * added, every sub-band keeps a bitset of its channels per data rate, and
+ * the channels usable now are kept per data rate as the union of the
+ * bitsets of the sub-bands out of their duty cycle off time. A sub-band
+ * leaves that union when a transmission starts on it and joins it again,
+ * through a heap of busy sub-bands, once its off time is over. Selecting
+ * a channel then costs a few word operations (one word up to 64
+ * channels) plus the heap work of the transmissions, amortized over them,
+ * whatever the size of the plan. The waiting time when no channel is
+ * available is not constant: GetWaitingTime pops busy sub-bands until one
+ * has a channel of the data rate, and pushes back the ones it passed, so a
+ * call costs O(b log b) for b busy sub-bands.
+ *
+ * The device MACs do not use this class: they still choose channels and
+ * wait through their LogicalLoraChannelHelper, so the per-uplink cost of
+ * the MAC is unchanged. program1 only builds its channel plan from it,
+ * and lora-bench --case=channels measures it against the list walk of
+ * LogicalLoraChannelHelper.
+ *
+ * Times are integer nanoseconds. The off time after a transmission and
+ * the sub-band of a frequency follow LogicalLoraChannelHelper::AddEvent
+ * and SubBand::BelongsToSubBand; the aggregated duty cycle is not
+ * modelled.
+ */
+
+#ifndef CHANNEL_AVAILABILITY_H
+#define CHANNEL_AVAILABILITY_H
+
+#include "ns3/assert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class ChannelAvailability
+{
+public:
+  static const uint8_t nDataRates = 8;
+
+  struct SubBand
+  {
+    double firstFrequencyMHz;
+    double lastFrequencyMHz;
+    double dutyCycle;
+    double maxTxPowerDbm;
+  };
+
+  struct Channel
+  {
+    double frequencyMHz;
+    uint8_t minDataRate;
+    uint8_t maxDataRate;
+    uint32_t subBand;
+    bool enabled;
+  };
+
+  ChannelAvailability ()
+      : m_nowNs (0)
+  {
+  }
+
+  /**
+   * \return the index of the sub-band.
+   */
+  uint32_t
+  AddSubBand (double firstFrequencyMHz, double lastFrequencyMHz, double dutyCycle,
+              double maxTxPowerDbm)
+  {
+    m_subBands.push_back (
+        SubBand{firstFrequencyMHz, lastFrequencyMHz, dutyCycle, maxTxPowerDbm});
+    m_subBandState.push_back (SubBandState ());
+    m_subBandState.back ().channels.resize (nDataRates * GetNWords ());
+    return m_subBands.size () - 1;
+  }
+
+  /**
+   * Add an enabled channel, in the first sub-band containing its
+   * frequency.
+   *
+   * \return the index of the channel.
+   */
+  uint32_t
+  AddChannel (double frequencyMHz, uint8_t minDataRate, uint8_t maxDataRate)
+  {
+    NS_ASSERT (minDataRate <= maxDataRate && maxDataRate < nDataRates);
+    uint32_t subBand = 0;
+    while (subBand < m_subBands.size () &&
+           !(frequencyMHz > m_subBands[subBand].firstFrequencyMHz &&
+             frequencyMHz < m_subBands[subBand].lastFrequencyMHz))
+      {
+        subBand++;
+      }
+    NS_ASSERT_MSG (subBand < m_subBands.size (),
+                   "No sub-band contains the channel at " << frequencyMHz << " MHz");
+
+    uint32_t channel = m_channels.size ();
+    m_channels.push_back (Channel{frequencyMHz, minDataRate, maxDataRate, subBand, false});
+    if (channel % 64 == 0)
+      {
+        Widen ();
+      }
+    SetEnabled (channel, true);
+    return channel;
+  }
+
+  /**
+   * Enable or disable a channel, as a LinkAdrReq channel mask does.
+   */
+  void
+  SetEnabled (uint32_t channel, bool enabled)
+  {
+    Channel &c = m_channels[channel];
+    if (c.enabled == enabled)
+      {
+        return;
+      }
+    c.enabled = enabled;
+    SubBandState &state = m_subBandState[c.subBand];
+    bool free = state.nextNs <= m_nowNs;
+    uint32_t w = channel / 64;
+    uint64_t bit = uint64_t (1) << (channel % 64);
+    for (uint8_t dr = c.minDataRate; dr <= c.maxDataRate; dr++)
+      {
+        uint64_t &mask = state.channels[dr * GetNWords () + w];
+        mask = enabled ? mask | bit : mask & ~bit;
+        if (free)
+          {
+            uint64_t &available = m_available[dr * GetNWords () + w];
+            available = enabled ? available | bit : available & ~bit;
+          }
+      }
+  }
+
+  /**
+   * Account a transmission starting now on a channel: its sub-band is off
+   * for duration / dutyCycle - duration.
+   */
+  void
+  AddEvent (int64_t nowNs, int64_t durationNs, uint32_t channel)
+  {
+    Advance (nowNs);
+    uint32_t subBand = m_channels[channel].subBand;
+    SubBandState &state = m_subBandState[subBand];
+    int64_t nextNs =
+        nowNs + std::llround (durationNs / m_subBands[subBand].dutyCycle) - durationNs;
+    if (nextNs <= nowNs)
+      {
+        return;
+      }
+
+    if (state.nextNs <= nowNs)
+      {
+        // The sub-band was free: its channels are no longer available
+        for (uint32_t i = 0; i < m_available.size (); i++)
+          {
+            m_available[i] &= ~state.channels[i];
+          }
+      }
+    state.nextNs = nextNs;
+    m_busy.push (Busy (nextNs, subBand));
+  }
+
+  /**
+   * \return the number of enabled channels of a data rate whose sub-band
+   *         can transmit now.
+   */
+  uint32_t
+  GetNAvailable (int64_t nowNs, uint8_t dataRate)
+  {
+    Advance (nowNs);
+    uint32_t n = 0;
+    for (uint32_t w = 0; w < GetNWords (); w++)
+      {
+        n += __builtin_popcountll (m_available[dataRate * GetNWords () + w]);
+      }
+    return n;
+  }
+
+  /**
+   * Pick one of the channels available now for a data rate: the one at
+   * position floor (u * n) among the n available, in channel order. With
+   * u uniform in [0, 1), this is a uniform choice among the channels of the
+   * data rate. It is not the MAC's choice: GetChannelForTx and
+   * GetNextTransmissionDelay do not filter the channels by data rate, and
+   * the shuffle of the channel list they use is not uniform.
+   *
+   * \return the channel, or -1 if none is available.
+   */
+  int32_t
+  Select (int64_t nowNs, uint8_t dataRate, double u)
+  {
+    uint32_t n = GetNAvailable (nowNs, dataRate);
+    if (n == 0)
+      {
+        return -1;
+      }
+    uint32_t k = std::min (uint32_t (u * n), n - 1);
+    const uint64_t *available = &m_available[dataRate * GetNWords ()];
+    uint32_t w = 0;
+    uint32_t count = __builtin_popcountll (available[0]);
+    while (k >= count)
+      {
+        k -= count;
+        w++;
+        count = __builtin_popcountll (available[w]);
+      }
+    uint64_t word = available[w];
+    for (uint32_t i = 0; i < k; i++)
+      {
+        word &= word - 1;
+      }
+    return int32_t (w * 64 + __builtin_ctzll (word));
+  }
+
+  /**
+   * A call pops the busy sub-bands without a channel of the data rate
+   * and pushes them back, so it costs O(b log b) for b busy sub-bands.
+   *
+   * \return the time until a channel of the data rate is available, 0 if
+   *         one is now, or the largest int64_t if the data rate has no
+   *         enabled channel.
+   */
+  int64_t
+  GetWaitingTime (int64_t nowNs, uint8_t dataRate)
+  {
+    if (GetNAvailable (nowNs, dataRate) > 0)
+      {
+        return 0;
+      }
+    // All sub-bands with channels of this data rate are busy, so in the
+    // heap: the first of them to be free again sets the waiting time
+    int64_t next = std::numeric_limits<int64_t>::max ();
+    m_popped.clear ();
+    while (!m_busy.empty () && next == std::numeric_limits<int64_t>::max ())
+      {
+        Busy top = m_busy.top ();
+        m_busy.pop ();
+        if (m_subBandState[top.second].nextNs != top.first)
+          {
+            continue; // Stale entry, the sub-band was used again
+          }
+        m_popped.push_back (top);
+        if (HasDataRate (top.second, dataRate))
+          {
+            next = top.first;
+          }
+      }
+    for (uint32_t i = 0; i < m_popped.size (); i++)
+      {
+        m_busy.push (m_popped[i]);
+      }
+    return next == std::numeric_limits<int64_t>::max () ? next : next - nowNs;
+  }
+
+  uint32_t
+  GetNSubBands (void) const
+  {
+    return m_subBands.size ();
+  }
+
+  const SubBand &
+  GetSubBand (uint32_t subBand) const
+  {
+    return m_subBands[subBand];
+  }
+
+  uint32_t
+  GetNChannels (void) const
+  {
+    return m_channels.size ();
+  }
+
+  const Channel &
+  GetChannel (uint32_t channel) const
+  {
+    return m_channels[channel];
+  }
+
+private:
+  typedef std::pair<int64_t, uint32_t> Busy; //!< Next transmission time, sub-band
+
+  struct SubBandState
+  {
+    SubBandState ()
+        : nextNs (std::numeric_limits<int64_t>::min ())
+    {
+    }
+
+    int64_t nextNs;
+    std::vector<uint64_t> channels; //!< Enabled channels per data rate
+  };
+
+  uint32_t
+  GetNWords (void) const
+  {
+    return (m_channels.size () + 63) / 64;
+  }
+
+  bool
+  HasDataRate (uint32_t subBand, uint8_t dataRate) const
+  {
+    const std::vector<uint64_t> &channels = m_subBandState[subBand].channels;
+    for (uint32_t w = 0; w < GetNWords (); w++)
+      {
+        if (channels[dataRate * GetNWords () + w] != 0)
+          {
+            return true;
+          }
+      }
+    return false;
+  }
+
+  /**
+   * Grow the bitsets by one word, the last channel having started a new
+   * one.
+   */
+  void
+  Widen (void)
+  {
+    uint32_t words = GetNWords ();
+    std::vector<uint64_t> available (nDataRates * words, 0);
+    for (uint8_t dr = 0; dr < nDataRates; dr++)
+      {
+        for (uint32_t w = 0; w + 1 < words; w++)
+          {
+            available[dr * words + w] = m_available[dr * (words - 1) + w];
+          }
+      }
+    m_available.swap (available);
+
+    for (uint32_t s = 0; s < m_subBandState.size (); s++)
+      {
+        std::vector<uint64_t> channels (nDataRates * words, 0);
+        for (uint8_t dr = 0; dr < nDataRates; dr++)
+          {
+            for (uint32_t w = 0; w + 1 < words; w++)
+              {
+                channels[dr * words + w] = m_subBandState[s].channels[dr * (words - 1) + w];
+              }
+          }
+        m_subBandState[s].channels.swap (channels);
+      }
+  }
+
+  /**
+   * Give the channels of the sub-bands whose off time is over back to the
+   * available sets.
+   */
+  void
+  Advance (int64_t nowNs)
+  {
+    NS_ASSERT_MSG (nowNs >= m_nowNs, "Time went backwards");
+    m_nowNs = nowNs;
+    while (!m_busy.empty () && m_busy.top ().first <= nowNs)
+      {
+        Busy top = m_busy.top ();
+        m_busy.pop ();
+        const SubBandState &state = m_subBandState[top.second];
+        if (state.nextNs != top.first)
+          {
+            continue; // Stale entry, the sub-band was used again
+          }
+        for (uint32_t i = 0; i < m_available.size (); i++)
+          {
+            m_available[i] |= state.channels[i];
+          }
+      }
+  }
+
+  std::vector<SubBand> m_subBands;
+  std::vector<SubBandState> m_subBandState;
+  std::vector<Channel> m_channels;
+  std::vector<uint64_t> m_available; //!< Channels usable now, per data rate
+  std::priority_queue<Busy, std::vector<Busy>, std::greater<Busy>> m_busy;
+  std::vector<Busy> m_popped; //!< Valid entries popped by GetWaitingTime
+  int64_t m_nowNs;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* CHANNEL_AVAILABILITY_H */
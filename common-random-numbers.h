@@ -0,0 +1,201 @@
+/*
+ * Common random numbers for scenario comparisons.
+ *
+ * By default every random variable gets the next free stream when it is
+ * created, so adding a gateway or reordering devices shifts the streams of
+ * everything created afterwards. In this mode the propagation models are
+ * pinned to streams derived from their role in the scenario, and the start
+ * time of each device is a hash of its site (its position), the seed and
+ * the run number. Two variants of
+ * a scenario run with the same RngRun therefore draw the same start time
+ * for the same sensor and the same propagation randomness, and their
+ * difference is measured with much less variance.
+ *
+ * Streams are a 40 bit hash of the name. A model chain given a stream by
+ * AssignStreams uses the streams that follow it too, so every name
+ * reserves the whole range its consumer used, and two overlapping ranges
+ * are a fatal error rather than being resolved in creation order.
+ *
+ * Limits:
+ *  - a correlated shadowing model in the loss chain still draws its
+ *    values from its one stream in the order links are first queried, so
+ *    its shadowing is neither per link nor independent of that order;
+ *    only its stream is pinned;
+ *  - devices sharing a position are told apart by their rank among the
+ *    devices of that position in container order, so for them the name
+ *    does depend on creation order. Scenarios that cycle through a short
+ *    position list (area-bogor uses 4) are in that case for almost every
+ *    device: removing or reordering devices there changes which start
+ *    time each one gets.
+ */
+
+#ifndef COMMON_RANDOM_NUMBERS_H
+#define COMMON_RANDOM_NUMBERS_H
+
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include "ns3/periodic-sender.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/rng-seed-manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class CommonRandomNumbers
+{
+public:
+  /**
+   * \return the stream pinned to a consumer name, reserved for one stream
+   *         until Reserve says otherwise.
+   */
+  int64_t
+  GetStream (const std::string &consumer)
+  {
+    int64_t stream = int64_t (Hash (consumer) & ((uint64_t (1) << 40) - 1));
+    Reserve (consumer, stream, 1);
+    return stream;
+  }
+
+  /**
+   * Reserve the streams [first, first + count) for a consumer.
+   */
+  void
+  Reserve (const std::string &consumer, int64_t first, int64_t count)
+  {
+    int64_t last = first + std::max (count, int64_t (1));
+    // Ranges are disjoint, so only the ones starting before last and the
+    // one right before first can overlap
+    std::map<int64_t, Range>::iterator it = m_streams.lower_bound (first);
+    if (it != m_streams.begin ())
+      {
+        --it;
+      }
+    for (; it != m_streams.end () && it->first < last; ++it)
+      {
+        if (it->second.consumer != consumer && it->second.last > first)
+          {
+            NS_FATAL_ERROR ("Random stream collision between " << it->second.consumer
+                                                               << " and " << consumer);
+          }
+      }
+    Range &range = m_streams[first];
+    range.consumer = consumer;
+    range.last = std::max (range.last, last);
+  }
+
+  /**
+   * A name for a node: its position to the centimetre, plus its rank among
+   * the nodes at that position so far, which is the only part that depends
+   * on creation order. Call it once per node.
+   */
+  std::string
+  GetSiteName (Ptr<Node> node)
+  {
+    Vector pos = node->GetObject<MobilityModel> ()->GetPosition ();
+    std::ostringstream site;
+    site << std::llround (pos.x * 100) << "," << std::llround (pos.y * 100) << ","
+         << std::llround (pos.z * 100);
+    uint32_t occurrence = m_sites[site.str ()]++;
+    site << "#" << occurrence;
+    return site.str ();
+  }
+
+  /**
+   * Pin the loss chain (shadowing) and the propagation delay model.
+   */
+  void
+  PinPropagation (Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay)
+  {
+    int64_t stream = GetStream ("channel/loss");
+    Reserve ("channel/loss", stream, loss->AssignStreams (stream));
+    stream = GetStream ("channel/delay");
+    Reserve ("channel/delay", stream, delay->AssignStreams (stream));
+  }
+
+  /**
+   * Redraw the initial delay of the PeriodicSender of every device from a
+   * hash of its site name, the seed and the run number. No random variable
+   * is created, so the automatic streams of the rest of the scenario are
+   * left as they are.
+   *
+   * \return the initial delay of each device, in container order.
+   */
+  std::vector<Time>
+  PinStartTimes (NodeContainer endDevices, Time period)
+  {
+    std::vector<Time> delays;
+    for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+      {
+        std::string name = "device/" + GetSiteName (*i) + "/start";
+        Time delay = Seconds (GetUniform (name) * period.GetSeconds ());
+        delays.push_back (delay);
+
+        for (uint32_t a = 0; a < (*i)->GetNApplications (); a++)
+          {
+            Ptr<PeriodicSender> app = DynamicCast<PeriodicSender> ((*i)->GetApplication (a));
+            if (app != 0)
+              {
+                app->SetInitialDelay (delay);
+              }
+          }
+      }
+    return delays;
+  }
+
+private:
+  struct Range
+  {
+    Range ()
+        : last (0)
+    {
+    }
+
+    std::string consumer;
+    int64_t last; //!< One past the last stream
+  };
+
+  static uint64_t
+  Hash (const std::string &name)
+  {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (std::string::const_iterator c = name.begin (); c != name.end (); ++c)
+      {
+        hash ^= uint8_t (*c);
+        hash *= 1099511628211ull;
+      }
+    return hash;
+  }
+
+  /**
+   * \return a value in [0, 1) fixed by a name, the seed and the run
+   *         number: the splitmix64 finalizer of their hash.
+   */
+  static double
+  GetUniform (const std::string &name)
+  {
+    uint64_t x = Hash (name) ^ (uint64_t (RngSeedManager::GetSeed ()) << 32) ^
+                 (RngSeedManager::GetRun () * 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return double (x >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  std::map<int64_t, Range> m_streams; //!< Reserved ranges, by first stream
+  std::map<std::string, uint32_t> m_sites;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* COMMON_RANDOM_NUMBERS_H */
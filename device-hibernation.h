@@ -0,0 +1,317 @@
+/*
+ * Hibernation of end devices that no gateway can hear.
+ *
+ * A device whose best gateway receives it below the SF12 sensitivity even
+ * at maximum transmission power never gets a packet through. Such devices
+ * keep their PeriodicSender installed (so the random start times drawn for
+ * the other devices do not change), but the application is never started;
+ * instead, one lightweight event per period records the packet in the
+ * LoraPacketTracker as sent by the device and lost at every gateway,
+ * without going through the MAC, the PHY or the channel.
+ *
+ * This changes the model, which is why it is off unless asked for:
+ *  - hibernated packets no longer reach the gateways, so they stop adding
+ *    interference energy there, and a packet they would have destroyed on
+ *    the same spreading factor can now be received;
+ *  - at each gateway the packet is recorded as LOST_BECAUSE_TX if that
+ *    gateway is transmitting when it starts, and as UNDER_SENSITIVITY
+ *    otherwise; a gateway whose reception paths are all busy would report
+ *    NO_MORE_RECEIVERS instead, which is counted as UNDER_SENSITIVITY here.
+ *
+ * Devices are only re-evaluated when a device or gateway position changes.
+ * A device that becomes reachable is woken up with a fresh application;
+ * awake devices are never put back to sleep.
+ *
+ * This only holds when the loss is deterministic, so hibernation is
+ * refused when shadowing is in the loss chain.
+ */
+
+#ifndef DEVICE_HIBERNATION_H
+#define DEVICE_HIBERNATION_H
+
+#include "link-budget.h"
+#include "lora-phy-tables.h"
+#include "static-position-store.h"
+
+#include "ns3/log.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/lora-packet-tracker.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/periodic-sender-helper.h"
+#include "ns3/periodic-sender.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/simulator.h"
+
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class DeviceHibernation
+{
+public:
+  DeviceHibernation (StaticPositionStore &endDevices, StaticPositionStore &gateways,
+                     Ptr<LoraChannel> channel, bool distanceOnlyLoss)
+      : m_endDevices (endDevices),
+        m_gateways (gateways),
+        m_channel (channel),
+        m_distanceOnlyLoss (distanceOnlyLoss),
+        m_maxTxPowerDbm (16),
+        m_sensitivityDbm (LoraRegionTables<Eu868Profile>::gwSensitivity[0]),
+        m_tracker (0)
+  {
+  }
+
+  DeviceHibernation (const DeviceHibernation &) = delete;
+  DeviceHibernation &operator= (const DeviceHibernation &) = delete;
+
+  /**
+   * Highest power a device can transmit with, 16 dBm in EU868.
+   */
+  void
+  SetMaxTxPower (double dbm)
+  {
+    m_maxTxPowerDbm = dbm;
+  }
+
+  /**
+   * Gateway sensitivity at the slowest data rate.
+   */
+  void
+  SetSensitivity (double dbm)
+  {
+    m_sensitivityDbm = dbm;
+  }
+
+  /**
+   * Use these first transmission delays, one per device, instead of
+   * drawing them (see CommonRandomNumbers::PinStartTimes).
+   */
+  void
+  SetInitialDelays (const std::vector<Time> &delays)
+  {
+    m_initialDelays = delays;
+  }
+
+  /**
+   * Also hand every packet recorded as lost to a callback, with the node
+   * id of its device and, per gateway, whether it was transmitting, for
+   * reports that do not read the tracker.
+   */
+  void
+  SetLostPacketCallback (
+      Callback<void, Ptr<const Packet>, uint32_t, const std::vector<bool> &> callback)
+  {
+    m_lostPacket = callback;
+  }
+
+  /**
+   * Put to sleep the devices with no viable receiver. The applications
+   * must already be installed and started.
+   *
+   * \param appHelper helper used to wake devices up again.
+   * \param packetSize application payload size.
+   * \return the number of hibernated devices.
+   */
+  uint32_t
+  Hibernate (PeriodicSenderHelper appHelper, Time period, uint8_t packetSize, Time stopTime,
+             LoraPacketTracker &tracker)
+  {
+    if (!m_distanceOnlyLoss)
+      {
+        NS_LOG_UNCOND ("Hibernation needs a deterministic loss model, ignoring it");
+        return 0;
+      }
+
+    m_appHelper = appHelper;
+    m_period = period;
+    m_packetSize = packetSize;
+    m_stopTime = stopTime;
+    m_tracker = &tracker;
+    if (m_initialDelays.empty ())
+      {
+        // Only now, so that runs without hibernation use no stream for it
+        m_initialDelay = CreateObject<UniformRandomVariable> ();
+      }
+    m_asleep.assign (m_endDevices.GetN (), false);
+    m_fCnt.assign (m_endDevices.GetN (), 0);
+
+    m_endDevices.SetChangeCallback (MakeCallback (&DeviceHibernation::DeviceMoved, this));
+    m_gateways.SetChangeCallback (MakeCallback (&DeviceHibernation::GatewayMoved, this));
+
+    std::vector<DeviceLink> links =
+        ComputeBestLinks (m_endDevices, m_gateways, m_channel, m_maxTxPowerDbm, true);
+
+    uint32_t hibernated = 0;
+    for (uint32_t i = 0; i < m_endDevices.GetN (); i++)
+      {
+        if (links[i].rxPowerDbm >= m_sensitivityDbm)
+          {
+            continue;
+          }
+
+        // Keep the application from ever starting
+        Ptr<Node> node = m_endDevices.GetNode (i);
+        for (uint32_t a = 0; a < node->GetNApplications (); a++)
+          {
+            Ptr<PeriodicSender> app = DynamicCast<PeriodicSender> (node->GetApplication (a));
+            if (app != 0)
+              {
+                app->SetStartTime (m_stopTime + m_period);
+              }
+          }
+
+        m_asleep[i] = true;
+        hibernated++;
+        Time delay = m_initialDelays.empty ()
+                         ? Seconds (m_initialDelay->GetValue (0, m_period.GetSeconds ()))
+                         : m_initialDelays[i];
+        Simulator::ScheduleWithContext (node->GetId (), delay, &DeviceHibernation::SendLost, this,
+                                        i);
+      }
+
+    return hibernated;
+  }
+
+  bool
+  IsAsleep (uint32_t i) const
+  {
+    return i < m_asleep.size () && m_asleep[i];
+  }
+
+private:
+  /**
+   * Account one packet of device i as sent and lost under sensitivity at
+   * every gateway, then wait for the next period.
+   */
+  void
+  SendLost (uint32_t i)
+  {
+    if (!m_asleep[i])
+      {
+        return;
+      }
+
+    Ptr<Node> node = m_endDevices.GetNode (i);
+    Ptr<EndDeviceLorawanMac> mac = node->GetDevice (0)
+                                       ->GetObject<LoraNetDevice> ()
+                                       ->GetMac ()
+                                       ->GetObject<EndDeviceLorawanMac> ();
+
+    // Same headers the MAC would add, so that the tracker sees an uplink
+    Ptr<Packet> packet = Create<Packet> (m_packetSize);
+    LoraFrameHeader frameHdr;
+    frameHdr.SetAsUplink ();
+    frameHdr.SetFPort (1);
+    frameHdr.SetAddress (mac->GetDeviceAddress ());
+    frameHdr.SetFCnt (m_fCnt[i]++);
+    packet->AddHeader (frameHdr);
+    LorawanMacHeader macHdr;
+    macHdr.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_UP);
+    packet->AddHeader (macHdr);
+
+    m_tracker->MacTransmissionCallback (packet);
+    m_tracker->TransmissionCallback (packet, node->GetId ());
+    m_transmitting.resize (m_gateways.GetN ());
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        Ptr<Node> gateway = m_gateways.GetNode (g);
+        m_transmitting[g] =
+            gateway->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ()->IsTransmitting ();
+        if (m_transmitting[g])
+          {
+            m_tracker->LostBecauseTxCallback (packet, gateway->GetId ());
+          }
+        else
+          {
+            m_tracker->UnderSensitivityCallback (packet, gateway->GetId ());
+          }
+      }
+    if (!m_lostPacket.IsNull ())
+      {
+        m_lostPacket (packet, node->GetId (), m_transmitting);
+      }
+
+    if (Simulator::Now () + m_period < m_stopTime)
+      {
+        Simulator::Schedule (m_period, &DeviceHibernation::SendLost, this, i);
+      }
+  }
+
+  void
+  DeviceMoved (uint32_t i)
+  {
+    if (IsAsleep (i))
+      {
+        Reevaluate (i);
+      }
+  }
+
+  void
+  GatewayMoved (uint32_t)
+  {
+    for (uint32_t i = 0; i < m_asleep.size (); i++)
+      {
+        if (m_asleep[i])
+          {
+            Reevaluate (i);
+          }
+      }
+  }
+
+  void
+  Reevaluate (uint32_t i)
+  {
+    Ptr<MobilityModel> position = m_endDevices.GetMobility (i);
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        double rxPower =
+            m_channel->GetRxPower (m_maxTxPowerDbm, position, m_gateways.GetMobility (g));
+        if (rxPower >= m_sensitivityDbm)
+          {
+            Wake (i);
+            return;
+          }
+      }
+  }
+
+  void
+  Wake (uint32_t i)
+  {
+    m_asleep[i] = false;
+    if (Simulator::Now () >= m_stopTime)
+      {
+        return;
+      }
+
+    // Applications are initialized (and started) after being added
+    ApplicationContainer app = m_appHelper.Install (m_endDevices.GetNode (i));
+    app.Start (Seconds (0));
+    app.Stop (m_stopTime - Simulator::Now ());
+  }
+
+  StaticPositionStore &m_endDevices;
+  StaticPositionStore &m_gateways;
+  Ptr<LoraChannel> m_channel;
+  bool m_distanceOnlyLoss;
+  double m_maxTxPowerDbm;
+  double m_sensitivityDbm;
+
+  PeriodicSenderHelper m_appHelper;
+  Time m_period;
+  uint8_t m_packetSize;
+  Time m_stopTime;
+  LoraPacketTracker *m_tracker;
+  Callback<void, Ptr<const Packet>, uint32_t, const std::vector<bool> &> m_lostPacket;
+  Ptr<UniformRandomVariable> m_initialDelay;
+  std::vector<Time> m_initialDelays;
+
+  std::vector<bool> m_asleep;
+  std::vector<uint16_t> m_fCnt;
+  std::vector<bool> m_transmitting; //!< Per gateway, for the last packet recorded
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* DEVICE_HIBERNATION_H */
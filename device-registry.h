@@ -0,0 +1,329 @@
+/*
+ * Flat, address-keyed containers for per-device and per-uplink state.
+ *
+ * DeviceRegistry maps a LoraDeviceAddress to a value with open addressing
+ * and linear probing in a single power-of-two array, so a lookup is one
+ * hash and usually one cache line, instead of the tree walk of a
+ * std::map<LoraDeviceAddress, ...>.
+ *
+ * UplinkDedupTable recognises the copies of the same uplink forwarded by
+ * different gateways. Entries are keyed by (address, FCnt) and are
+ * removed once a fixed window has passed, so the table only ever holds
+ * the packets in flight and its size does not grow with the simulation
+ * length.
+ *
+ * Both serve the scenarios' own accounting (ResultsReport,
+ * NetworkServerMonitor). The network server's device lookups are private
+ * to NetworkStatus and still go through its std::map; replacing them
+ * needs changes to the lorawan module.
+ */
+
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include "ns3/lora-device-address.h"
+#include "ns3/nstime.h"
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+inline uint32_t
+HashDeviceAddress (uint32_t address)
+{
+  // Fibonacci hashing: addresses from the same generator only differ in
+  // the low bits, this spreads them over the whole table
+  return address * 2654435769u;
+}
+
+template <class Value>
+class DeviceRegistry
+{
+public:
+  explicit DeviceRegistry (uint32_t expectedDevices = 16)
+      : m_size (0)
+  {
+    Rehash (expectedDevices);
+  }
+
+  /**
+   * Insert a device, or return the existing entry for its address.
+   */
+  Value &
+  Insert (LoraDeviceAddress address)
+  {
+    if (2 * (m_size + 1) > m_slots.size ())
+      {
+        Rehash (m_size + 1);
+      }
+
+    uint32_t key = address.Get ();
+    uint32_t i = Probe (key);
+    if (!m_slots[i].used)
+      {
+        m_slots[i].used = true;
+        m_slots[i].key = key;
+        m_slots[i].value = Value ();
+        m_size++;
+      }
+    return m_slots[i].value;
+  }
+
+  /**
+   * \return the entry of the device, or 0 if it was never inserted.
+   */
+  Value *
+  Find (LoraDeviceAddress address)
+  {
+    uint32_t i = Probe (address.Get ());
+    return m_slots[i].used ? &m_slots[i].value : 0;
+  }
+
+  const Value *
+  Find (LoraDeviceAddress address) const
+  {
+    uint32_t i = Probe (address.Get ());
+    return m_slots[i].used ? &m_slots[i].value : 0;
+  }
+
+  uint32_t
+  GetN (void) const
+  {
+    return m_size;
+  }
+
+  /**
+   * Call f (address, value) for every device, in table order.
+   */
+  template <class F>
+  void
+  ForEach (F f) const
+  {
+    for (typename std::vector<Slot>::const_iterator it = m_slots.begin (); it != m_slots.end ();
+         ++it)
+      {
+        if (it->used)
+          {
+            f (LoraDeviceAddress (it->key), it->value);
+          }
+      }
+  }
+
+private:
+  struct Slot
+  {
+    Slot ()
+        : used (false),
+          key (0)
+    {
+    }
+
+    bool used;
+    uint32_t key;
+    Value value;
+  };
+
+  uint32_t
+  Probe (uint32_t key) const
+  {
+    uint32_t mask = m_slots.size () - 1;
+    uint32_t i = HashDeviceAddress (key) & mask;
+    while (m_slots[i].used && m_slots[i].key != key)
+      {
+        i = (i + 1) & mask;
+      }
+    return i;
+  }
+
+  void
+  Rehash (uint32_t capacity)
+  {
+    uint32_t size = 16;
+    while (size < 2 * capacity)
+      {
+        size *= 2;
+      }
+
+    std::vector<Slot> old;
+    old.swap (m_slots);
+    m_slots.resize (size);
+    for (typename std::vector<Slot>::iterator it = old.begin (); it != old.end (); ++it)
+      {
+        if (it->used)
+          {
+            m_slots[Probe (it->key)] = *it;
+          }
+      }
+  }
+
+  std::vector<Slot> m_slots;
+  uint32_t m_size;
+};
+
+class UplinkDedupTable
+{
+public:
+  /**
+   * \param window how long after its first copy an uplink can still be
+   *        reported by another gateway.
+   * \param inFlight expected number of distinct uplinks within a window.
+   */
+  UplinkDedupTable (Time window, uint32_t inFlight)
+      : m_window (window),
+        m_size (0)
+  {
+    uint32_t size = 16;
+    while (size < 2 * inFlight)
+      {
+        size *= 2;
+      }
+    m_slots.resize (size);
+  }
+
+  /**
+   * Record a copy of an uplink.
+   *
+   * \return true if this is the first copy of the uplink within the
+   *         window, false for duplicates from other gateways.
+   */
+  bool
+  Insert (LoraDeviceAddress address, uint16_t fCnt, Time now)
+  {
+    Expire (now);
+
+    uint64_t key = (uint64_t (address.Get ()) << 16) | fCnt;
+    uint32_t i = Probe (key);
+    if (m_slots[i].used)
+      {
+        return false;
+      }
+
+    if (2 * (m_size + 1) > m_slots.size ())
+      {
+        Grow ();
+        i = Probe (key);
+      }
+    m_slots[i].used = true;
+    m_slots[i].key = key;
+    m_size++;
+    m_order.push_back (std::make_pair (key, now));
+    return true;
+  }
+
+  uint32_t
+  GetCapacity (void) const
+  {
+    return m_slots.size ();
+  }
+
+private:
+  struct Slot
+  {
+    Slot ()
+        : used (false),
+          key (0)
+    {
+    }
+
+    bool used;
+    uint64_t key;
+  };
+
+  uint32_t
+  Home (uint64_t key) const
+  {
+    return HashDeviceAddress (uint32_t (key >> 16) ^ (uint32_t (key & 0xffff) * 40503u)) &
+           (m_slots.size () - 1);
+  }
+
+  uint32_t
+  Probe (uint64_t key) const
+  {
+    uint32_t mask = m_slots.size () - 1;
+    uint32_t i = Home (key);
+    while (m_slots[i].used && m_slots[i].key != key)
+      {
+        i = (i + 1) & mask;
+      }
+    return i;
+  }
+
+  /**
+   * Drop the uplinks whose window is over. They were inserted in time
+   * order, so they are at the front of m_order.
+   */
+  void
+  Expire (Time now)
+  {
+    while (!m_order.empty () && now - m_order.front ().second >= m_window)
+      {
+        Erase (m_order.front ().first);
+        m_order.pop_front ();
+      }
+  }
+
+  /**
+   * Backward-shift deletion, which keeps probe chains intact without
+   * leaving tombstones behind.
+   */
+  void
+  Erase (uint64_t key)
+  {
+    uint32_t mask = m_slots.size () - 1;
+    uint32_t i = Probe (key);
+    if (!m_slots[i].used)
+      {
+        return;
+      }
+    m_slots[i].used = false;
+    m_size--;
+
+    uint32_t j = i;
+    while (true)
+      {
+        j = (j + 1) & mask;
+        if (!m_slots[j].used)
+          {
+            break;
+          }
+        // Move j back into the hole unless its home lies cyclically in (i, j]
+        uint32_t k = Home (m_slots[j].key);
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays)
+          {
+            m_slots[i] = m_slots[j];
+            m_slots[j].used = false;
+            i = j;
+          }
+      }
+  }
+
+  void
+  Grow (void)
+  {
+    std::vector<Slot> old;
+    old.swap (m_slots);
+    m_slots.resize (2 * old.size ());
+    for (std::vector<Slot>::iterator it = old.begin (); it != old.end (); ++it)
+      {
+        if (it->used)
+          {
+            m_slots[Probe (it->key)] = *it;
+          }
+      }
+  }
+
+  Time m_window;
+  std::vector<Slot> m_slots;
+  uint32_t m_size;
+  std::deque<std::pair<uint64_t, Time>> m_order;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* DEVICE_REGISTRY_H */
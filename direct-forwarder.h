@@ -0,0 +1,152 @@
+/*
+ * In-process backhaul between gateways and the network server.
+ *
+ * The Forwarder application copies every uplink a gateway receives and
+ * sends it over the point-to-point link created by NetworkServerHelper,
+ * which serialises it and schedules its transmission and reception again.
+ * DirectForwarder takes the Forwarder's place on the gateway's LoRa
+ * device and hands the very same packet, with the LoraTag carrying its
+ * reception metadata, to NetworkServer::Receive after a fixed delay,
+ * using the gateway's point-to-point address as the sender so that the
+ * network server finds the gateway status it expects.
+ *
+ * Downlinks still travel over the point-to-point link: they are rare, and
+ * the network server sends them through the link device it stores per
+ * gateway. DirectForwarder takes them from the gateway side of the link
+ * and passes them to the LoRa device, as the Forwarder does.
+ */
+
+#ifndef DIRECT_FORWARDER_H
+#define DIRECT_FORWARDER_H
+
+#include "ns3/lora-net-device.h"
+#include "ns3/network-server.h"
+#include "ns3/node-container.h"
+#include "ns3/point-to-point-channel.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/simulator.h"
+
+namespace ns3 {
+namespace lorawan {
+
+class DirectForwarder : public SimpleRefCount<DirectForwarder>
+{
+public:
+  DirectForwarder (Ptr<LoraNetDevice> loraNetDevice, Ptr<NetDevice> gatewayDevice,
+                   Ptr<NetDevice> serverDevice, Ptr<NetworkServer> networkServer, Time delay)
+      : m_loraNetDevice (loraNetDevice),
+        m_gatewayAddress (gatewayDevice->GetAddress ()),
+        m_serverDevice (serverDevice),
+        m_networkServer (networkServer),
+        m_delay (delay)
+  {
+  }
+
+  bool
+  ReceiveFromLora (Ptr<NetDevice> /* loraNetDevice */, Ptr<const Packet> packet,
+                   uint16_t /* protocol */, const Address & /* sender */)
+  {
+    if (m_delay.IsZero ())
+      {
+        Deliver (packet);
+      }
+    else
+      {
+        Simulator::ScheduleWithContext (m_serverDevice->GetNode ()->GetId (), m_delay,
+                                        &DirectForwarder::Deliver, this, packet);
+      }
+    return true;
+  }
+
+  bool
+  ReceiveFromPointToPoint (Ptr<NetDevice> /* pointToPointNetDevice */, Ptr<const Packet> packet,
+                           uint16_t /* protocol */, const Address & /* sender */)
+  {
+    Ptr<Packet> packetCopy = packet->Copy ();
+    m_loraNetDevice->Send (packetCopy);
+    return true;
+  }
+
+private:
+  void
+  Deliver (Ptr<const Packet> packet)
+  {
+    m_networkServer->Receive (m_serverDevice, packet, 0x0800, m_gatewayAddress);
+  }
+
+  Ptr<LoraNetDevice> m_loraNetDevice;
+  Address m_gatewayAddress;
+  Ptr<NetDevice> m_serverDevice;
+  Ptr<NetworkServer> m_networkServer;
+  Time m_delay;
+};
+
+class DirectForwarderHelper
+{
+public:
+  DirectForwarderHelper ()
+      : m_delay (MilliSeconds (2))
+  {
+  }
+
+  /**
+   * Fixed gateway to network server delay. Defaults to the 2 ms of the
+   * links built by NetworkServerHelper.
+   */
+  void
+  SetDelay (Time delay)
+  {
+    m_delay = delay;
+  }
+
+  /**
+   * Install a DirectForwarder on each gateway. NetworkServerHelper::Install
+   * must have been called, since the gateways are identified by their
+   * point-to-point link to the network server.
+   */
+  void
+  Install (NodeContainer gateways, Ptr<NetworkServer> networkServer) const
+  {
+    for (NodeContainer::Iterator i = gateways.Begin (); i != gateways.End (); ++i)
+      {
+        Ptr<Node> gateway = *i;
+        Ptr<LoraNetDevice> loraNetDevice;
+        Ptr<PointToPointNetDevice> gatewayDevice;
+        for (uint32_t d = 0; d < gateway->GetNDevices (); d++)
+          {
+            if (loraNetDevice == 0)
+              {
+                loraNetDevice = gateway->GetDevice (d)->GetObject<LoraNetDevice> ();
+              }
+            if (gatewayDevice == 0)
+              {
+                gatewayDevice = gateway->GetDevice (d)->GetObject<PointToPointNetDevice> ();
+              }
+          }
+        NS_ASSERT (loraNetDevice != 0 && gatewayDevice != 0);
+
+        // The network server side of the gateway's link
+        Ptr<Channel> link = gatewayDevice->GetChannel ();
+        Ptr<NetDevice> serverDevice = link->GetDevice (0);
+        if (serverDevice == gatewayDevice)
+          {
+            serverDevice = link->GetDevice (1);
+          }
+
+        Ptr<DirectForwarder> forwarder = Create<DirectForwarder> (
+            loraNetDevice, gatewayDevice, serverDevice, networkServer, m_delay);
+        loraNetDevice->SetReceiveCallback (
+            MakeCallback (&DirectForwarder::ReceiveFromLora, forwarder));
+        gatewayDevice->SetReceiveCallback (
+            MakeCallback (&DirectForwarder::ReceiveFromPointToPoint, forwarder));
+      }
+  }
+
+private:
+  Time m_delay;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* DIRECT_FORWARDER_H */
@@ -0,0 +1,284 @@
+/*
+ * Binary event log for the lorawan trace sources.
+ *
+ * Instead of formatting text, every PHY/MAC event is stored as a 24 byte
+ * record (time, packet uid, node id, event type, spreading factor) in a
+ * fixed-size ring. When the ring is full it is written to the output file
+ * in one block; in flight recorder mode the oldest records are overwritten
+ * instead, and only the last events of the run are written at the end.
+ *
+ * The file starts with a small header and is decoded offline by
+ * lora-event-log-decode.cc, or by anything reading EventRecord.
+ */
+
+#ifndef EVENT_RING_LOG_H
+#define EVENT_RING_LOG_H
+
+#include "ns3/lora-net-device.h"
+#include "ns3/lora-tag.h"
+#include "ns3/network-server.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+struct EventRecord
+{
+  int64_t timeNs;
+  uint64_t packetUid;
+  uint32_t nodeId;
+  uint16_t event;
+  uint16_t sf;
+};
+
+static_assert (sizeof (EventRecord) == 24, "EventRecord must stay packed");
+
+class EventRingLog
+{
+public:
+  enum Event
+  {
+    TX_START = 0,
+    RECEIVED,
+    INTERFERED,
+    NO_MORE_RECEIVERS,
+    UNDER_SENSITIVITY,
+    LOST_BECAUSE_TX,
+    GW_MAC_RECEIVED,
+    NS_RECEIVED,
+    N_EVENTS
+  };
+
+  static constexpr uint32_t magic = 0x4c52454c; // "LREL"
+  static constexpr uint32_t version = 1;
+
+  /**
+   * \param capacity number of records kept in memory, rounded up to a
+   *        power of two.
+   */
+  explicit EventRingLog (uint32_t capacity = 1 << 16)
+      : m_head (0),
+        m_count (0),
+        m_written (0),
+        m_stream (true)
+  {
+    uint32_t size = 1;
+    while (size < capacity)
+      {
+        size *= 2;
+      }
+    m_ring.resize (size);
+  }
+
+  EventRingLog (const EventRingLog &) = delete;
+  EventRingLog &operator= (const EventRingLog &) = delete;
+
+  ~EventRingLog ()
+  {
+    Flush ();
+  }
+
+  /**
+   * \param stream write every full ring, or only keep the last one.
+   */
+  void
+  SetOutputFile (std::string filename, bool stream = true)
+  {
+    m_stream = stream;
+    m_file.open (filename.c_str (), std::ios::binary | std::ios::trunc);
+    uint32_t header[3] = {magic, version, uint32_t (sizeof (EventRecord))};
+    m_file.write (reinterpret_cast<const char *> (header), sizeof (header));
+  }
+
+  /**
+   * Connect to the PHY traces of end devices and gateways, to the gateway
+   * MACs and to the network server.
+   */
+  void
+  Install (NodeContainer endDevices, NodeContainer gateways, Ptr<NetworkServer> networkServer)
+  {
+    for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+      {
+        Ptr<LoraPhy> phy = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ();
+        phy->TraceConnectWithoutContext ("StartSending",
+                                         MakeCallback (&EventRingLog::TxStart, this));
+      }
+
+    for (NodeContainer::Iterator i = gateways.Begin (); i != gateways.End (); ++i)
+      {
+        Ptr<LoraNetDevice> device = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ();
+        Ptr<LoraPhy> phy = device->GetPhy ();
+        phy->TraceConnectWithoutContext ("ReceivedPacket",
+                                         MakeCallback (&EventRingLog::Received, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseInterference",
+                                         MakeCallback (&EventRingLog::Interfered, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseNoMoreReceivers",
+                                         MakeCallback (&EventRingLog::NoMoreReceivers, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseUnderSensitivity",
+                                         MakeCallback (&EventRingLog::UnderSensitivity, this));
+        phy->TraceConnectWithoutContext ("NoReceptionBecauseTransmitting",
+                                         MakeCallback (&EventRingLog::LostBecauseTx, this));
+        device->GetMac ()->TraceConnectWithoutContext (
+            "ReceivedPacket", MakeCallback (&EventRingLog::GwMacReceived, this));
+      }
+
+    if (networkServer != 0)
+      {
+        networkServer->TraceConnectWithoutContext (
+            "ReceivedPacket", MakeCallback (&EventRingLog::NsReceived, this));
+      }
+  }
+
+  void
+  Record (Event event, Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    LoraTag tag;
+    uint16_t sf = packet->PeekPacketTag (tag) ? tag.GetSpreadingFactor () : 0;
+
+    EventRecord &r = m_ring[m_head];
+    r.timeNs = Simulator::Now ().GetNanoSeconds ();
+    r.packetUid = packet->GetUid ();
+    r.nodeId = nodeId;
+    r.event = event;
+    r.sf = sf;
+
+    m_head = (m_head + 1) & (m_ring.size () - 1);
+    if (m_count < m_ring.size ())
+      {
+        m_count++;
+      }
+    if (m_head == 0 && m_stream)
+      {
+        Flush ();
+      }
+  }
+
+  /**
+   * Write the records held in memory, oldest first.
+   */
+  void
+  Flush (void)
+  {
+    if (!m_file.is_open () || m_count == 0)
+      {
+        return;
+      }
+    uint32_t size = m_ring.size ();
+    uint32_t first = (m_head + size - m_count) & (size - 1);
+    uint32_t tail = std::min (m_count, size - first);
+    m_file.write (reinterpret_cast<const char *> (&m_ring[first]), tail * sizeof (EventRecord));
+    m_file.write (reinterpret_cast<const char *> (&m_ring[0]),
+                  (m_count - tail) * sizeof (EventRecord));
+    m_file.flush ();
+    m_written += m_count;
+    m_count = 0;
+  }
+
+  uint64_t
+  GetWritten (void) const
+  {
+    return m_written;
+  }
+
+  static const char *
+  GetEventName (uint16_t event)
+  {
+    static const char *names[N_EVENTS] = {"TX_START",          "RECEIVED",
+                                          "INTERFERED",        "NO_MORE_RECEIVERS",
+                                          "UNDER_SENSITIVITY", "LOST_BECAUSE_TX",
+                                          "GW_MAC_RECEIVED",   "NS_RECEIVED"};
+    return event < N_EVENTS ? names[event] : "UNKNOWN";
+  }
+
+  /**
+   * Print a binary log as text, one record per line.
+   *
+   * \return false if the file is not an event log of this version.
+   */
+  static bool
+  Decode (std::istream &in, std::ostream &out)
+  {
+    uint32_t header[3];
+    if (!in.read (reinterpret_cast<char *> (header), sizeof (header)) || header[0] != magic ||
+        header[1] != version || header[2] != sizeof (EventRecord))
+      {
+        return false;
+      }
+
+    EventRecord r;
+    while (in.read (reinterpret_cast<char *> (&r), sizeof (r)))
+      {
+        out << r.timeNs << " " << GetEventName (r.event) << " node " << r.nodeId << " packet "
+            << r.packetUid << " sf " << r.sf << std::endl;
+      }
+    return true;
+  }
+
+private:
+  void
+  TxStart (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (TX_START, packet, nodeId);
+  }
+
+  void
+  Received (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (RECEIVED, packet, nodeId);
+  }
+
+  void
+  Interfered (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (INTERFERED, packet, nodeId);
+  }
+
+  void
+  NoMoreReceivers (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (NO_MORE_RECEIVERS, packet, nodeId);
+  }
+
+  void
+  UnderSensitivity (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (UNDER_SENSITIVITY, packet, nodeId);
+  }
+
+  void
+  LostBecauseTx (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    Record (LOST_BECAUSE_TX, packet, nodeId);
+  }
+
+  void
+  GwMacReceived (Ptr<const Packet> packet)
+  {
+    Record (GW_MAC_RECEIVED, packet, Simulator::GetContext ());
+  }
+
+  void
+  NsReceived (Ptr<const Packet> packet)
+  {
+    Record (NS_RECEIVED, packet, Simulator::GetContext ());
+  }
+
+  std::vector<EventRecord> m_ring;
+  uint32_t m_head;
+  uint32_t m_count;
+  uint64_t m_written;
+  bool m_stream;
+  std::ofstream m_file;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* EVENT_RING_LOG_H */
@@ -0,0 +1,513 @@
+/*
+ * Heap usage of a scenario, broken down by component.
+ *
+ * Built with -DAREA_HEAP_ACCOUNTING, this header replaces the global
+ * operator new and delete of the program (so it must be included by one
+ * translation unit only, the scenario itself). Every allocation carries a
+ * small header with its size and the component it is charged to, and
+ * live bytes, peak live bytes and allocation counts are kept per
+ * component.
+ *
+ * The component of an allocation is, in order:
+ *  - the tag set with SetTag or a HeapScope, for the setup phases of the
+ *    scenario (channel, nodes and devices, applications, network server);
+ *  - while the simulation runs, the innermost frame of the call stack
+ *    that belongs to a class followed on its own: the packet tracker
+ *    (LoraPacketTracker), interference (LoraInterferenceHelper),
+ *    shadowing (CorrelatedShadowingPropagationLossModel) and the
+ *    scheduler (the ns-3 schedulers, SimulatorImpl and MakeEvent, so the
+ *    event queue and the events themselves). Frames are told apart by the
+ *    name of their dynamic symbol, resolved once per return address with
+ *    dladdr, so inlined code counts as its caller's. glibc only, and
+ *    older glibc needs -ldl;
+ *  - otherwise the role of the node whose event is executing: end device
+ *    events (MAC, applications, packets), gateway events (reception
+ *    paths), network server events (device status, replies), or events
+ *    without a node (global bookkeeping).
+ *
+ * Memory is charged to the component that allocated it until it is freed,
+ * wherever that happens. Resolving the call stack makes every allocation
+ * of the run much slower, which is why all this is a separate build.
+ * Without AREA_HEAP_ACCOUNTING nothing is replaced and all the counters
+ * stay at zero.
+ */
+
+#ifndef HEAP_ACCOUNTING_H
+#define HEAP_ACCOUNTING_H
+
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(AREA_HEAP_ACCOUNTING) && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+namespace ns3 {
+namespace lorawan {
+
+class HeapAccounting
+{
+public:
+  enum Component
+  {
+    UNTAGGED = 0,
+    CHANNEL,
+    NODES_DEVICES,
+    APPLICATIONS,
+    NETWORK_SERVER,
+    END_DEVICE_EVENTS,
+    GATEWAY_EVENTS,
+    NETWORK_SERVER_EVENTS,
+    GLOBAL_EVENTS,
+    PACKET_TRACKER,
+    INTERFERENCE,
+    SHADOWING,
+    SCHEDULER,
+    REPORT,
+    N_COMPONENTS
+  };
+
+  static bool
+  IsCompiledIn (void)
+  {
+#ifdef AREA_HEAP_ACCOUNTING
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static const char *
+  GetName (Component c)
+  {
+    static const char *names[N_COMPONENTS] = {"untagged",
+                                              "channel",
+                                              "nodes-devices",
+                                              "applications",
+                                              "network-server",
+                                              "end-device-events",
+                                              "gateway-events",
+                                              "network-server-events",
+                                              "global-events",
+                                              "packet-tracker",
+                                              "interference",
+                                              "shadowing",
+                                              "scheduler",
+                                              "report"};
+    return names[c];
+  }
+
+  /**
+   * Charge the allocations of this thread to a component.
+   *
+   * \return the previous tag.
+   */
+  static Component
+  SetTag (Component c)
+  {
+    Component previous = t_tag;
+    t_tag = c;
+    return previous;
+  }
+
+  /**
+   * Charge untagged allocations made while the simulation runs to the role
+   * of the node of the executing event. Call it on the simulation thread
+   * right before Simulator::Run, and EndRun right after it.
+   */
+  static void
+  BeginRun (NodeContainer endDevices, NodeContainer gateways, NodeContainer networkServers)
+  {
+    std::vector<uint8_t> &roles = GetRoles ();
+    AssignRole (roles, endDevices, END_DEVICE_EVENTS);
+    AssignRole (roles, gateways, GATEWAY_EVENTS);
+    AssignRole (roles, networkServers, NETWORK_SERVER_EVENTS);
+    s_runThread.store (std::this_thread::get_id ());
+    s_running.store (true);
+  }
+
+  static void
+  EndRun (void)
+  {
+    s_running.store (false);
+  }
+
+  struct Stats
+  {
+    int64_t liveBytes;
+    int64_t peakBytes;
+    uint64_t allocations;
+  };
+
+  static Stats
+  GetStats (Component c)
+  {
+    Stats s;
+    s.liveBytes = s_live[c].load (std::memory_order_relaxed);
+    s.peakBytes = s_peak[c].load (std::memory_order_relaxed);
+    s.allocations = s_allocations[c].load (std::memory_order_relaxed);
+    return s;
+  }
+
+  /**
+   * Allocate with an accounting header in front, keeping the default new
+   * alignment.
+   */
+  static void *
+  Allocate (std::size_t size)
+  {
+    char *block = static_cast<char *> (std::malloc (size + headerSize));
+    if (block == 0)
+      {
+        return 0;
+      }
+    Component c = GetCurrent ();
+    AllocationHeader *header = reinterpret_cast<AllocationHeader *> (block);
+    header->size = size;
+    header->component = c;
+
+    int64_t live = s_live[c].fetch_add (size, std::memory_order_relaxed) + size;
+    int64_t peak = s_peak[c].load (std::memory_order_relaxed);
+    while (live > peak &&
+           !s_peak[c].compare_exchange_weak (peak, live, std::memory_order_relaxed))
+      {
+      }
+    s_allocations[c].fetch_add (1, std::memory_order_relaxed);
+    return block + headerSize;
+  }
+
+  static void
+  Free (void *p)
+  {
+    if (p == 0)
+      {
+        return;
+      }
+    char *block = static_cast<char *> (p) - headerSize;
+    AllocationHeader *header = reinterpret_cast<AllocationHeader *> (block);
+    s_live[header->component].fetch_sub (header->size, std::memory_order_relaxed);
+    std::free (block);
+  }
+
+private:
+  struct AllocationHeader
+  {
+    uint64_t size;
+    uint32_t component;
+  };
+
+  static const std::size_t headerSize = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+  static_assert (sizeof (AllocationHeader) <= headerSize, "Accounting header too large");
+
+  static std::vector<uint8_t> &
+  GetRoles (void)
+  {
+    static std::vector<uint8_t> roles;
+    return roles;
+  }
+
+  static void
+  AssignRole (std::vector<uint8_t> &roles, NodeContainer nodes, Component role)
+  {
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        uint32_t id = (*i)->GetId ();
+        if (id >= roles.size ())
+          {
+            roles.resize (id + 1, GLOBAL_EVENTS);
+          }
+        roles[id] = role;
+      }
+  }
+
+  static Component
+  GetCurrent (void)
+  {
+    if (t_tag != UNTAGGED || !s_running.load (std::memory_order_relaxed) ||
+        std::this_thread::get_id () != s_runThread.load (std::memory_order_relaxed))
+      {
+        return t_tag;
+      }
+    // Simulator::GetContext may log, and so allocate, itself
+    if (t_resolving)
+      {
+        return GLOBAL_EVENTS;
+      }
+    t_resolving = true;
+    Component c = GetFrameComponent ();
+    uint32_t context = Simulator::GetContext ();
+    t_resolving = false;
+    if (c != UNTAGGED)
+      {
+        return c;
+      }
+    const std::vector<uint8_t> &roles = GetRoles ();
+    return context < roles.size () ? Component (roles[context]) : GLOBAL_EVENTS;
+  }
+
+  /**
+   * \return the component of the innermost frame of the call stack that
+   *         belongs to a class followed on its own, or UNTAGGED.
+   */
+  static Component
+  GetFrameComponent (void)
+  {
+#if defined(AREA_HEAP_ACCOUNTING) && defined(__GLIBC__)
+    void *frames[maxFrames];
+    int n = backtrace (frames, maxFrames);
+    for (int f = 0; f < n; f++)
+      {
+        Component c = GetCachedFrameComponent (reinterpret_cast<uintptr_t> (frames[f]));
+        if (c != UNTAGGED)
+          {
+            return c;
+          }
+      }
+#endif
+    return UNTAGGED;
+  }
+
+  /**
+   * Look a return address up in a fixed table, so that it is resolved
+   * once and without allocating.
+   */
+  static Component
+  GetCachedFrameComponent (uintptr_t pc)
+  {
+    struct Entry
+    {
+      uintptr_t pc;
+      uint8_t component;
+    };
+    static Entry cache[frameCacheSize];
+
+    uint32_t mask = frameCacheSize - 1;
+    uint32_t i = uint32_t ((pc >> 2) * 2654435769u) & mask;
+    for (uint32_t probe = 0; probe < frameCacheSize; probe++, i = (i + 1) & mask)
+      {
+        if (cache[i].pc == pc)
+          {
+            return Component (cache[i].component);
+          }
+        if (cache[i].pc == 0)
+          {
+            cache[i].pc = pc;
+            cache[i].component = ResolveFrame (pc);
+            return Component (cache[i].component);
+          }
+      }
+    return ResolveFrame (pc);
+  }
+
+  static Component
+  ResolveFrame (uintptr_t pc)
+  {
+#if defined(AREA_HEAP_ACCOUNTING) && defined(__GLIBC__)
+    static const struct
+    {
+      const char *pattern;
+      Component component;
+    } patterns[] = {{"LoraPacketTracker", PACKET_TRACKER},
+                    {"LoraInterferenceHelper", INTERFERENCE},
+                    {"CorrelatedShadowing", SHADOWING},
+                    {"MapScheduler", SCHEDULER},
+                    {"HeapScheduler", SCHEDULER},
+                    {"ListScheduler", SCHEDULER},
+                    {"CalendarScheduler", SCHEDULER},
+                    {"PriorityQueueScheduler", SCHEDULER},
+                    {"SimulatorImpl", SCHEDULER},
+                    {"MakeEvent", SCHEDULER}};
+    Dl_info info;
+    if (dladdr (reinterpret_cast<void *> (pc), &info) == 0 || info.dli_sname == 0)
+      {
+        return UNTAGGED;
+      }
+    for (const auto &p : patterns)
+      {
+        if (std::strstr (info.dli_sname, p.pattern) != 0)
+          {
+            return p.component;
+          }
+      }
+#else
+    (void) pc;
+#endif
+    return UNTAGGED;
+  }
+
+  static const int maxFrames = 24;
+  static const uint32_t frameCacheSize = 1 << 14;
+
+  static thread_local Component t_tag;
+  static thread_local bool t_resolving;
+  static std::atomic<bool> s_running;
+  static std::atomic<std::thread::id> s_runThread;
+  static std::atomic<int64_t> s_live[N_COMPONENTS];
+  static std::atomic<int64_t> s_peak[N_COMPONENTS];
+  static std::atomic<uint64_t> s_allocations[N_COMPONENTS];
+};
+
+inline thread_local HeapAccounting::Component HeapAccounting::t_tag = HeapAccounting::UNTAGGED;
+inline thread_local bool HeapAccounting::t_resolving = false;
+inline std::atomic<bool> HeapAccounting::s_running (false);
+inline std::atomic<std::thread::id> HeapAccounting::s_runThread;
+inline std::atomic<int64_t> HeapAccounting::s_live[HeapAccounting::N_COMPONENTS] = {};
+inline std::atomic<int64_t> HeapAccounting::s_peak[HeapAccounting::N_COMPONENTS] = {};
+inline std::atomic<uint64_t> HeapAccounting::s_allocations[HeapAccounting::N_COMPONENTS] = {};
+
+/**
+ * Charge the allocations of a block to a component.
+ */
+class HeapScope
+{
+public:
+  explicit HeapScope (HeapAccounting::Component c)
+      : m_previous (HeapAccounting::SetTag (c))
+  {
+  }
+
+  ~HeapScope ()
+  {
+    HeapAccounting::SetTag (m_previous);
+  }
+
+private:
+  HeapAccounting::Component m_previous;
+};
+
+/**
+ * Writes the per-component counters every period of simulated time and
+ * once more at the end, one line per component:
+ *   time_s component live_bytes peak_bytes allocations
+ */
+class HeapReport
+{
+public:
+  void
+  Start (std::string filename, Time period)
+  {
+    HeapScope scope (HeapAccounting::REPORT);
+    m_file.open (filename.c_str (), std::ios::trunc);
+    if (!HeapAccounting::IsCompiledIn ())
+      {
+        m_file << "# heap accounting not compiled in, build with -DAREA_HEAP_ACCOUNTING"
+               << std::endl;
+      }
+    m_file << "time_s component live_bytes peak_bytes allocations" << std::endl;
+    m_period = period;
+    Simulator::Schedule (m_period, &HeapReport::Periodic, this);
+  }
+
+  void
+  Write (double timeSeconds)
+  {
+    if (!m_file.is_open ())
+      {
+        return;
+      }
+    HeapScope scope (HeapAccounting::REPORT);
+    for (int c = 0; c < HeapAccounting::N_COMPONENTS; c++)
+      {
+        HeapAccounting::Stats s = HeapAccounting::GetStats (HeapAccounting::Component (c));
+        m_file << timeSeconds << " " << HeapAccounting::GetName (HeapAccounting::Component (c))
+               << " " << s.liveBytes << " " << s.peakBytes << " " << s.allocations << "\n";
+      }
+    m_file.flush ();
+  }
+
+private:
+  void
+  Periodic (void)
+  {
+    Write (Simulator::Now ().GetSeconds ());
+    Simulator::Schedule (m_period, &HeapReport::Periodic, this);
+  }
+
+  std::ofstream m_file;
+  Time m_period;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#ifdef AREA_HEAP_ACCOUNTING
+
+void *
+operator new (std::size_t size)
+{
+  void *p = ns3::lorawan::HeapAccounting::Allocate (size);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void *
+operator new[] (std::size_t size)
+{
+  return operator new (size);
+}
+
+void *
+operator new (std::size_t size, const std::nothrow_t &) noexcept
+{
+  return ns3::lorawan::HeapAccounting::Allocate (size);
+}
+
+void *
+operator new[] (std::size_t size, const std::nothrow_t &) noexcept
+{
+  return ns3::lorawan::HeapAccounting::Allocate (size);
+}
+
+void
+operator delete (void *p) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+void
+operator delete[] (void *p) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+void
+operator delete (void *p, std::size_t) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+void
+operator delete[] (void *p, std::size_t) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+void
+operator delete (void *p, const std::nothrow_t &) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+void
+operator delete[] (void *p, const std::nothrow_t &) noexcept
+{
+  ns3::lorawan::HeapAccounting::Free (p);
+}
+
+#endif /* AREA_HEAP_ACCOUNTING */
+
+#endif /* HEAP_ACCOUNTING_H */
@@ -0,0 +1,352 @@
+/*
+ * Network server ADR with constant work per uplink.
+ *
+ * The module's AdrComponent walks the stored reception history of a device
+ * on every gateway copy of every uplink. Here each device keeps a fixed
+ * ring of its last historyRange uplinks, one sample per uplink: the number
+ * of gateways that heard it and their received powers combined, with the
+ * sum over the ring updated as samples come in and leave. Gateway copies
+ * only touch the newest sample; the LinkAdrReq decision is taken once per
+ * uplink, when the network server prepares the reply to it.
+ *
+ * The decision and the defaults are those of AdrComponent: a history of 4
+ * uplinks, gateways and uplinks both combined by their average, no device
+ * margin, and the SNR margin over the demodulation floor of the current
+ * spreading factor spent in 3 dB steps on raising the data rate only. The
+ * transmission power is only lowered with the remaining steps, or raised
+ * back on a negative margin, if SetChangeTransmissionPower is set.
+ */
+
+#ifndef INCREMENTAL_ADR_COMPONENT_H
+#define INCREMENTAL_ADR_COMPONENT_H
+
+#include "device-registry.h"
+#include "uplink-header-view.h"
+
+#include "ns3/abort.h"
+#include "ns3/end-device-status.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/lora-tag.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/network-controller-components.h"
+#include "ns3/network-status.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class IncrementalAdrComponent : public NetworkControllerComponent
+{
+public:
+  /**
+   * How AdrComponent combines the gateways of an uplink, or the uplinks of
+   * the history.
+   */
+  enum CombiningMethod
+  {
+    AVERAGE,
+    MAXIMUM,
+    MINIMUM
+  };
+
+  static TypeId
+  GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::IncrementalAdrComponent")
+                            .SetGroupName ("lorawan")
+                            .AddConstructor<IncrementalAdrComponent> ()
+                            .SetParent<NetworkControllerComponent> ();
+    return tid;
+  }
+
+  IncrementalAdrComponent ()
+      : m_historyRange (4),
+        m_gatewayCombining (AVERAGE),
+        m_packetCombining (AVERAGE),
+        m_changeTxPower (false),
+        m_deviceMargin (0),
+        m_enabledChannels ({0, 1, 2}),
+        m_linkAdrReqs (0)
+  {
+  }
+
+  /**
+   * Number of uplinks a decision needs, and is taken over. Set it before
+   * the first uplink.
+   */
+  void
+  SetHistoryRange (uint32_t uplinks)
+  {
+    NS_ABORT_MSG_IF (uplinks == 0, "Empty ADR history");
+    m_historyRange = uplinks;
+  }
+
+  void
+  SetGatewayCombining (CombiningMethod method)
+  {
+    m_gatewayCombining = method;
+  }
+
+  void
+  SetPacketCombining (CombiningMethod method)
+  {
+    m_packetCombining = method;
+  }
+
+  /**
+   * Also spend the margin on the transmission power.
+   */
+  void
+  SetChangeTransmissionPower (bool change)
+  {
+    m_changeTxPower = change;
+  }
+
+  /**
+   * Margin kept over the demodulation floor, in dB.
+   */
+  void
+  SetDeviceMargin (double marginDb)
+  {
+    m_deviceMargin = marginDb;
+  }
+
+  /**
+   * Channel mask sent in the LinkAdrReq commands.
+   */
+  void
+  SetEnabledChannels (const std::list<int> &channels)
+  {
+    m_enabledChannels = channels;
+  }
+
+  /**
+   * \return the LinkAdrReq commands issued so far.
+   */
+  uint64_t
+  GetLinkAdrReqs (void) const
+  {
+    return m_linkAdrReqs;
+  }
+
+  /**
+   * \return the mean number of gateways that heard the uplinks in the
+   *         history of a device, or 0 if it has none.
+   */
+  double
+  GetMeanGateways (LoraDeviceAddress address) const
+  {
+    const History *h = m_histories.Find (address);
+    return h == 0 || h->count == 0 ? 0 : double (h->gatewaySum) / h->count;
+  }
+
+  void
+  OnReceivedPacket (Ptr<const Packet> packet, Ptr<EndDeviceStatus> /* status */,
+                    Ptr<NetworkStatus> /* networkStatus */)
+  {
+    UplinkHeaderView header;
+    if (!header.Parse (packet))
+      {
+        return;
+      }
+
+    LoraTag tag;
+    packet->PeekPacketTag (tag);
+    double rxPower = tag.GetReceivePower ();
+
+    History &h = m_histories.Insert (header.GetAddress ());
+    if (h.samples.empty ())
+      {
+        h.samples.resize (m_historyRange);
+      }
+    if (h.count > 0 && header.GetFCnt () == h.lastFCnt)
+      {
+        h.AddCopy (rxPower, m_gatewayCombining);
+      }
+    else
+      {
+        h.AddUplink (rxPower);
+        h.lastFCnt = header.GetFCnt ();
+      }
+    h.adr = header.GetAdr ();
+    h.decided = false;
+  }
+
+  void
+  BeforeSendingReply (Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> /* networkStatus */)
+  {
+    Ptr<ClassAEndDeviceLorawanMac> mac = status->GetMac ();
+    History *h = m_histories.Find (mac->GetDeviceAddress ());
+    if (h == 0 || h->decided || !h->adr || h->count < m_historyRange)
+      {
+        return;
+      }
+    h->decided = true;
+
+    uint8_t sf = status->GetFirstReceiveWindowSpreadingFactor ();
+    double txPower = mac->GetTransmissionPower ();
+    uint8_t newSf = sf;
+    double newTxPower = txPower;
+
+    double snr = RxPowerToSnr (h->Combine (m_packetCombining));
+    int steps = std::floor ((snr - requiredSnr[12 - sf] - m_deviceMargin) / 3);
+    while (steps > 0 && newSf > 7)
+      {
+        newSf--;
+        steps--;
+      }
+    while (m_changeTxPower && steps > 0 && newTxPower > 2)
+      {
+        newTxPower -= 2;
+        steps--;
+      }
+    while (m_changeTxPower && steps < 0 && newTxPower < 14)
+      {
+        newTxPower += 2;
+        steps++;
+      }
+
+    if (newSf != sf || newTxPower != txPower)
+      {
+        status->m_reply.frameHeader.AddLinkAdrReq (12 - newSf, (16 - newTxPower) / 2,
+                                                   m_enabledChannels, 1);
+        status->m_reply.frameHeader.SetAsDownlink ();
+        status->m_reply.macHeader.SetMType (LorawanMacHeader::UNCONFIRMED_DATA_DOWN);
+        status->m_reply.needsReply = true;
+        m_linkAdrReqs++;
+      }
+  }
+
+  void
+  OnFailedReply (Ptr<EndDeviceStatus> /* status */, Ptr<NetworkStatus> /* networkStatus */)
+  {
+  }
+
+private:
+  /**
+   * Demodulation floor of SF12 to SF7, in dB.
+   */
+  static constexpr double requiredSnr[6] = {-20.0, -17.5, -15.0, -12.5, -10.0, -7.5};
+
+  static double
+  RxPowerToSnr (double rxPowerDbm)
+  {
+    // Thermal noise over 125 kHz plus a 6 dB noise figure
+    return rxPowerDbm + 174 - 10 * std::log10 (125000.0) - 6;
+  }
+
+  /**
+   * The gateways that heard one uplink.
+   */
+  struct Sample
+  {
+    double power; //!< Received powers combined over the gateways, in dBm
+    double powerSum;
+    double powerMax;
+    double powerMin;
+    uint32_t gateways;
+  };
+
+  struct History
+  {
+    History ()
+        : head (0),
+          count (0),
+          powerSum (0),
+          gatewaySum (0),
+          lastFCnt (0),
+          adr (false),
+          decided (false)
+    {
+    }
+
+    /**
+     * Start the sample of a new uplink, dropping the oldest one.
+     */
+    void
+    AddUplink (double rxPower)
+    {
+      if (count == samples.size ())
+        {
+          powerSum -= samples[head].power;
+          gatewaySum -= samples[head].gateways;
+        }
+      else
+        {
+          count++;
+        }
+      Sample &sample = samples[head];
+      sample.power = sample.powerSum = sample.powerMax = sample.powerMin = rxPower;
+      sample.gateways = 1;
+      powerSum += rxPower;
+      gatewaySum++;
+      head = (head + 1) % samples.size ();
+    }
+
+    /**
+     * Another gateway heard the newest uplink.
+     */
+    void
+    AddCopy (double rxPower, CombiningMethod method)
+    {
+      Sample &sample = samples[(head + samples.size () - 1) % samples.size ()];
+      sample.powerSum += rxPower;
+      sample.powerMax = std::max (sample.powerMax, rxPower);
+      sample.powerMin = std::min (sample.powerMin, rxPower);
+      sample.gateways++;
+      gatewaySum++;
+
+      double power = method == MAXIMUM   ? sample.powerMax
+                     : method == MINIMUM ? sample.powerMin
+                                         : sample.powerSum / sample.gateways;
+      powerSum += power - sample.power;
+      sample.power = power;
+    }
+
+    /**
+     * \return the received power of the uplinks in the history, combined.
+     */
+    double
+    Combine (CombiningMethod method) const
+    {
+      if (method == AVERAGE)
+        {
+          return powerSum / count;
+        }
+      double power = samples[0].power;
+      for (uint32_t i = 1; i < count; i++)
+        {
+          power = method == MAXIMUM ? std::max (power, samples[i].power)
+                                    : std::min (power, samples[i].power);
+        }
+      return power;
+    }
+
+    std::vector<Sample> samples;
+    uint32_t head;
+    uint32_t count;
+    double powerSum;
+    uint64_t gatewaySum;
+    uint16_t lastFCnt;
+    bool adr;
+    bool decided;
+  };
+
+  DeviceRegistry<History> m_histories;
+  uint32_t m_historyRange;
+  CombiningMethod m_gatewayCombining;
+  CombiningMethod m_packetCombining;
+  bool m_changeTxPower;
+  double m_deviceMargin;
+  std::list<int> m_enabledChannels;
+  uint64_t m_linkAdrReqs;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* INCREMENTAL_ADR_COMPONENT_H */
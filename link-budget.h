@@ -0,0 +1,129 @@
+/*
+ * Uplink link budget between end devices and gateways, computed over
+ * StaticPositionStore arrays.
+ *
+ * This replaces LorawanMacHelper::SetSpreadingFactorsUp for the area
+ * scenarios. The helper calls LoraChannel::GetRxPower for every device and
+ * every gateway; here, when the loss model only depends on distance (plain
+ * log-distance, no shadowing), the best gateway is the nearest one and is
+ * found with a single pass over contiguous coordinates, so only one
+ * GetRxPower call per device is needed.
+ */
+
+#ifndef LINK_BUDGET_H
+#define LINK_BUDGET_H
+
+#include "lora-phy-tables.h"
+#include "static-position-store.h"
+
+#include "ns3/class-a-end-device-lorawan-mac.h"
+#include "ns3/lora-channel.h"
+#include "ns3/lora-net-device.h"
+
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * The best gateway of a device and the power it is received with.
+ */
+struct DeviceLink
+{
+  uint32_t gateway; //!< Index of the gateway in its StaticPositionStore
+  double rxPowerDbm; //!< Power received by that gateway
+};
+
+/**
+ * Find, for every end device, the gateway that receives it with the
+ * highest power when transmitting at txPowerDbm.
+ *
+ * \param distanceOnlyLoss true if the channel loss is a monotonic function
+ *        of distance, in which case only the nearest gateway is evaluated.
+ */
+inline std::vector<DeviceLink>
+ComputeBestLinks (const StaticPositionStore &endDevices, const StaticPositionStore &gateways,
+                  Ptr<LoraChannel> channel, double txPowerDbm, bool distanceOnlyLoss)
+{
+  std::vector<DeviceLink> links (endDevices.GetN ());
+  const double *x = endDevices.GetX ();
+  const double *y = endDevices.GetY ();
+  const double *z = endDevices.GetZ ();
+
+  for (uint32_t i = 0; i < endDevices.GetN (); i++)
+    {
+      Ptr<MobilityModel> position = endDevices.GetMobility (i);
+
+      if (distanceOnlyLoss)
+        {
+          uint32_t nearest = gateways.FindNearest (x[i], y[i], z[i]);
+          links[i].gateway = nearest;
+          links[i].rxPowerDbm =
+              channel->GetRxPower (txPowerDbm, position, gateways.GetMobility (nearest));
+          continue;
+        }
+
+      links[i].gateway = 0;
+      links[i].rxPowerDbm = channel->GetRxPower (txPowerDbm, position, gateways.GetMobility (0));
+      for (uint32_t g = 1; g < gateways.GetN (); g++)
+        {
+          double rxPower = channel->GetRxPower (txPowerDbm, position, gateways.GetMobility (g));
+          if (rxPower > links[i].rxPowerDbm)
+            {
+              links[i].gateway = g;
+              links[i].rxPowerDbm = rxPower;
+            }
+        }
+    }
+
+  return links;
+}
+
+/**
+ * Same assignment rule as LorawanMacHelper::SetSpreadingFactorsUp (devices
+ * are assumed to transmit at 14 dBm), driven by the precomputed links and
+ * the region's sensitivity table.
+ *
+ * \return the number of devices per data rate, from the fastest 125 kHz
+ *         one (SF7) to DR0 (SF12), plus the out of range devices in the
+ *         last position.
+ */
+template <class Region = Eu868Profile>
+std::vector<int>
+SetSpreadingFactorsUp (const StaticPositionStore &endDevices, const StaticPositionStore &gateways,
+                       Ptr<LoraChannel> channel, bool distanceOnlyLoss)
+{
+  typedef LoraRegionTables<Region> Tables;
+
+  std::vector<int> sfQuantity (Region::maxSfDataRate + 2, 0);
+  std::vector<DeviceLink> links =
+      ComputeBestLinks (endDevices, gateways, channel, 14, distanceOnlyLoss);
+
+  for (uint32_t i = 0; i < endDevices.GetN (); i++)
+    {
+      Ptr<LoraNetDevice> loraNetDevice =
+          endDevices.GetNode (i)->GetDevice (0)->GetObject<LoraNetDevice> ();
+      NS_ASSERT (loraNetDevice != 0);
+      Ptr<ClassAEndDeviceLorawanMac> mac =
+          loraNetDevice->GetMac ()->GetObject<ClassAEndDeviceLorawanMac> ();
+      NS_ASSERT (mac != 0);
+
+      // Walk from the fastest data rate down to DR0
+      int dr = Region::maxSfDataRate;
+      while (dr >= 0 && links[i].rxPowerDbm <= Tables::edSensitivity[dr])
+        {
+          dr--;
+        }
+
+      // Devices out of range get DR0 too
+      mac->SetDataRate (dr >= 0 ? dr : 0);
+      sfQuantity[Region::maxSfDataRate - dr]++;
+    }
+
+  return sfQuantity;
+}
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* LINK_BUDGET_H */
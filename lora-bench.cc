@@ -0,0 +1,930 @@
+/*
+ * This script benchmarks the data structures the scenarios rely on, each
+ * against the straightforward implementation it replaces. Both run the
+ * same recorded workload, and the benchmark fails if their results differ.
+ *
+ * Cases (--case):
+ *   reception-paths  path allocation of a dense multi-channel gateway
+ *   interference     collision resolution at the end of each reception
+ *   channels         duty cycle and channel selection of a device with a
+ *                    large channel plan
+ *   deadlines        RX1 and RX2 deadlines of confirmed uplinks in a
+ *                    timing wheel, against an ordered map
+ *   surrogate        capacity estimate of a one-gateway area against a
+ *                    packet by packet replay of the same ALOHA model; fails
+ *                    if the delivery ratios differ by more than --tolerance
+ */
+
+#include "ns3/command-line.h"
+#include "ns3/random-variable-stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "batched-interference.h"
+#include "capacity-surrogate.h"
+#include "channel-availability.h"
+#include "lora-phy-tables.h"
+#include "reception-path-pool.h"
+#include "timing-wheel.h"
+
+using namespace ns3;
+using namespace lorawan;
+
+// Case parameters
+std::string benchCase = "reception-paths";
+int nPaths = 64;
+int nChannels = 8;
+int nPackets = 1000000;
+double load = 1.0;
+int repetitions = 5;
+double sliceMs = 10;
+int nSubBands = 8;
+int nDevices = 10000;
+double radius = 7500;
+double periodSeconds = 600;
+double tolerance = 0.05;
+
+/**
+ * Run a workload a few times and return the best time per operation, in
+ * nanoseconds.
+ */
+static double
+TimePerOperation (std::function<void (void)> workload, uint64_t nOperations)
+{
+  double best = 0;
+  for (int r = 0; r < repetitions; r++)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      workload ();
+      std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now ();
+      double ns = std::chrono::duration<double, std::nano> (stop - start).count () / nOperations;
+      if (r == 0 || ns < best)
+        {
+          best = ns;
+        }
+    }
+  return best;
+}
+
+/////////////////////
+// Reception paths //
+/////////////////////
+
+/**
+ * The path list walk of GatewayLoraPhy: the first free path on the
+ * frequency of the packet is locked.
+ */
+class LinearReceptionPaths
+{
+public:
+  void
+  AddPath (double frequencyMHz)
+  {
+    m_paths.push_back (Path{frequencyMHz, true});
+  }
+
+  int32_t
+  Acquire (double frequencyMHz)
+  {
+    for (uint32_t i = 0; i < m_paths.size (); i++)
+      {
+        if (m_paths[i].available && m_paths[i].frequency == frequencyMHz)
+          {
+            m_paths[i].available = false;
+            return int32_t (i);
+          }
+      }
+    return -1;
+  }
+
+  void
+  Release (uint32_t path)
+  {
+    m_paths[path].available = true;
+  }
+
+private:
+  struct Path
+  {
+    double frequency;
+    bool available;
+  };
+
+  std::vector<Path> m_paths;
+};
+
+/**
+ * Path operations of a gateway: a packet arriving on a channel, or the
+ * end of the reception on a path.
+ */
+struct PathOperation
+{
+  bool acquire;
+  uint32_t channel;
+  int32_t path;
+};
+
+static int
+RunReceptionPaths (void)
+{
+  std::vector<double> frequencies;
+  for (int c = 0; c < nChannels; c++)
+    {
+      frequencies.push_back (867.1 + 0.2 * c);
+    }
+
+  // Paths are spread over the channels round robin, as in program1
+  ReceptionPathPool pool;
+  LinearReceptionPaths linear;
+  for (int p = 0; p < nPaths; p++)
+    {
+      pool.AddPath (frequencies[p % nChannels]);
+      linear.AddPath (frequencies[p % nChannels]);
+    }
+
+  // Poisson arrivals of 23 byte uplinks on random channels and spreading
+  // factors, offering on average `load` packets per path
+  typedef LoraPhyTables<Eu868Profile, 23> Tables;
+  double meanOnAir = 0;
+  for (int dr = 0; dr <= Eu868Profile::maxSfDataRate; dr++)
+    {
+      meanOnAir += Tables::timeOnAir[dr] / (Eu868Profile::maxSfDataRate + 1);
+    }
+  Ptr<ExponentialRandomVariable> interArrival = CreateObject<ExponentialRandomVariable> ();
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+  double meanInterArrival = meanOnAir / (load * nPaths);
+
+  // Record the operation sequence once with the pool, then replay it on
+  // both implementations
+  typedef std::pair<double, int32_t> Reception;
+  std::priority_queue<Reception, std::vector<Reception>, std::greater<Reception>> ongoing;
+  std::vector<PathOperation> operations;
+  operations.reserve (2 * nPackets);
+  uint32_t lost = 0;
+  double now = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      now += interArrival->GetValue (meanInterArrival, 0);
+      while (!ongoing.empty () && ongoing.top ().first <= now)
+        {
+          pool.Release (ongoing.top ().second);
+          operations.push_back (PathOperation{false, 0, ongoing.top ().second});
+          ongoing.pop ();
+        }
+
+      uint32_t channel = uniform->GetInteger (0, nChannels - 1);
+      uint32_t dr = uniform->GetInteger (0, Eu868Profile::maxSfDataRate);
+      int32_t path = pool.Acquire (frequencies[channel]);
+      operations.push_back (PathOperation{true, channel, path});
+      if (path < 0)
+        {
+          lost++;
+        }
+      else
+        {
+          ongoing.push (Reception (now + Tables::timeOnAir[dr], path));
+        }
+    }
+  while (!ongoing.empty ())
+    {
+      pool.Release (ongoing.top ().second);
+      operations.push_back (PathOperation{false, 0, ongoing.top ().second});
+      ongoing.pop ();
+    }
+
+  // Replay, checking that every packet gets the same path
+  uint32_t mismatches = 0;
+  double linearNs = TimePerOperation (
+      [&] () {
+        for (std::vector<PathOperation>::const_iterator o = operations.begin ();
+             o != operations.end (); ++o)
+          {
+            if (o->acquire)
+              {
+                mismatches += linear.Acquire (frequencies[o->channel]) != o->path;
+              }
+            else
+              {
+                linear.Release (o->path);
+              }
+          }
+      },
+      operations.size ());
+  double poolNs = TimePerOperation (
+      [&] () {
+        for (std::vector<PathOperation>::const_iterator o = operations.begin ();
+             o != operations.end (); ++o)
+          {
+            if (o->acquire)
+              {
+                mismatches += pool.Acquire (frequencies[o->channel]) != o->path;
+              }
+            else
+              {
+                pool.Release (o->path);
+              }
+          }
+      },
+      operations.size ());
+
+  std::cout << "reception-paths: " << nPaths << " paths on " << nChannels << " channels, "
+            << nPackets << " packets, " << lost << " NO_MORE_RECEIVERS" << std::endl;
+  std::cout << "  path list walk: " << linearNs << " ns/operation" << std::endl;
+  std::cout << "  bitmap pool:    " << poolNs << " ns/operation" << std::endl;
+
+  if (mismatches > 0)
+    {
+      std::cerr << mismatches << " packets got a different path" << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+//////////////////
+// Interference //
+//////////////////
+
+static int
+RunInterference (void)
+{
+  typedef LoraPhyTables<Eu868Profile, 23> Tables;
+  int64_t maxOnAirNs = std::llround (Tables::timeOnAir[0] * 1e9);
+
+  // Poisson arrivals of 23 byte uplinks on random channels, spreading
+  // factors and receive powers, `load` receptions in progress on average
+  // per channel
+  double meanOnAir = 0;
+  for (int dr = 0; dr <= Eu868Profile::maxSfDataRate; dr++)
+    {
+      meanOnAir += Tables::timeOnAir[dr] / (Eu868Profile::maxSfDataRate + 1);
+    }
+  Ptr<ExponentialRandomVariable> interArrival = CreateObject<ExponentialRandomVariable> ();
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+  double meanInterArrival = meanOnAir / (load * nChannels);
+
+  std::vector<InterferenceEvent> events (nPackets);
+  double now = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      now += interArrival->GetValue (meanInterArrival, 0);
+      uint32_t dr = uniform->GetInteger (0, Eu868Profile::maxSfDataRate);
+      events[i].startNs = std::llround (now * 1e9);
+      events[i].endNs = events[i].startNs + std::llround (Tables::timeOnAir[dr] * 1e9);
+      events[i].rxPowerDbm = uniform->GetValue (-135, -80);
+      events[i].rxPowerW = DbmToW (events[i].rxPowerDbm);
+      events[i].sf = Eu868Profile::sf[dr];
+      events[i].channel = uniform->GetInteger (0, nChannels - 1);
+    }
+
+  // Receptions are resolved in the order they end
+  std::vector<uint32_t> byEnd (nPackets);
+  for (int i = 0; i < nPackets; i++)
+    {
+      byEnd[i] = i;
+    }
+  std::stable_sort (byEnd.begin (), byEnd.end (), [&events] (uint32_t a, uint32_t b) {
+    return events[a].endNs < events[b].endNs;
+  });
+
+  // Per packet, over an interference list holding the events of the last
+  // two seconds plus the longest time on air, as LoraInterferenceHelper
+  // keeps them
+  int64_t historyNs = 2000000000 + maxOnAirNs;
+  std::vector<uint8_t> perPacket (nPackets);
+  double perPacketNs = TimePerOperation (
+      [&] () {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        for (std::vector<uint32_t>::const_iterator t = byEnd.begin (); t != byEnd.end (); ++t)
+          {
+            int64_t end = events[*t].endNs;
+            while (last < events.size () && events[last].startNs <= end)
+              {
+                last++;
+              }
+            while (events[first].startNs < end - historyNs)
+              {
+                first++;
+              }
+            perPacket[*t] = PerPacketInterference (events, first, last, *t);
+          }
+      },
+      nPackets);
+
+  // Batches of the receptions ending within one slice, events being added
+  // to the per-channel lists as their reception starts
+  int64_t sliceNs = std::llround (sliceMs * 1e6);
+  std::vector<uint8_t> batchedOutcome (nPackets);
+  std::vector<uint32_t> targets;
+  std::vector<InterferenceEvent> targetEvents;
+  std::vector<uint8_t> outcomes;
+  double batchedNs = TimePerOperation (
+      [&] () {
+        BatchedInterference batched (maxOnAirNs);
+        uint32_t last = 0;
+        std::vector<uint32_t>::const_iterator t = byEnd.begin ();
+        while (t != byEnd.end ())
+          {
+            int64_t sliceEnd = events[*t].endNs + sliceNs;
+            targets.clear ();
+            targetEvents.clear ();
+            while (t != byEnd.end () && events[*t].endNs < sliceEnd)
+              {
+                targets.push_back (*t);
+                targetEvents.push_back (events[*t]);
+                ++t;
+              }
+            while (last < events.size () && events[last].startNs < targetEvents.back ().endNs)
+              {
+                batched.Add (events[last], last);
+                last++;
+              }
+            batched.Resolve (targets, targetEvents, outcomes);
+            for (uint32_t i = 0; i < targets.size (); i++)
+              {
+                batchedOutcome[targets[i]] = outcomes[i];
+              }
+          }
+      },
+      nPackets);
+
+  uint32_t interfered = 0;
+  uint32_t mismatches = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      interfered += perPacket[i] != 0;
+      mismatches += perPacket[i] != batchedOutcome[i];
+    }
+
+  std::cout << "interference: " << nPackets << " packets on " << nChannels << " channels, load "
+            << load << ", " << interfered << " INTERFERED" << std::endl;
+  std::cout << "  per packet:         " << perPacketNs << " ns/packet" << std::endl;
+  std::cout << "  batched (" << sliceMs << " ms): " << batchedNs << " ns/packet" << std::endl;
+
+  if (mismatches > 0)
+    {
+      std::cerr << mismatches << " packets got a different outcome" << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+//////////////
+// Channels //
+//////////////
+
+/**
+ * The lists of LogicalLoraChannelHelper: each query builds the enabled
+ * channel list and finds the sub-band of every channel by walking the
+ * sub-band list.
+ */
+class LinearChannelList
+{
+public:
+  void
+  AddSubBand (double firstFrequencyMHz, double lastFrequencyMHz, double dutyCycle)
+  {
+    m_subBands.push_back (SubBand{firstFrequencyMHz, lastFrequencyMHz, dutyCycle,
+                                  std::numeric_limits<int64_t>::min ()});
+  }
+
+  void
+  AddChannel (double frequencyMHz, uint8_t minDataRate, uint8_t maxDataRate)
+  {
+    m_channels.push_back (Channel{frequencyMHz, minDataRate, maxDataRate, true});
+  }
+
+  int32_t
+  Select (int64_t nowNs, uint8_t dataRate, double u)
+  {
+    std::vector<uint32_t> enabled = GetEnabledChannelList ();
+    std::vector<uint32_t> candidates;
+    for (std::vector<uint32_t>::const_iterator c = enabled.begin (); c != enabled.end (); ++c)
+      {
+        if (dataRate >= m_channels[*c].minDataRate && dataRate <= m_channels[*c].maxDataRate &&
+            GetWaitingTime (nowNs, *c) == 0)
+          {
+            candidates.push_back (*c);
+          }
+      }
+    if (candidates.empty ())
+      {
+        return -1;
+      }
+    uint32_t n = candidates.size ();
+    return int32_t (candidates[std::min (uint32_t (u * n), n - 1)]);
+  }
+
+  int64_t
+  GetWaitingTimeForDataRate (int64_t nowNs, uint8_t dataRate)
+  {
+    int64_t waiting = std::numeric_limits<int64_t>::max ();
+    std::vector<uint32_t> enabled = GetEnabledChannelList ();
+    for (std::vector<uint32_t>::const_iterator c = enabled.begin (); c != enabled.end (); ++c)
+      {
+        if (dataRate >= m_channels[*c].minDataRate && dataRate <= m_channels[*c].maxDataRate)
+          {
+            waiting = std::min (waiting, GetWaitingTime (nowNs, *c));
+          }
+      }
+    return waiting;
+  }
+
+  void
+  AddEvent (int64_t nowNs, int64_t durationNs, uint32_t channel)
+  {
+    SubBand &subBand = m_subBands[GetSubBand (m_channels[channel].frequencyMHz)];
+    int64_t nextNs = nowNs + std::llround (durationNs / subBand.dutyCycle) - durationNs;
+    if (nextNs > nowNs)
+      {
+        subBand.nextNs = nextNs;
+      }
+  }
+
+private:
+  struct SubBand
+  {
+    double firstFrequencyMHz;
+    double lastFrequencyMHz;
+    double dutyCycle;
+    int64_t nextNs;
+  };
+
+  struct Channel
+  {
+    double frequencyMHz;
+    uint8_t minDataRate;
+    uint8_t maxDataRate;
+    bool enabled;
+  };
+
+  std::vector<uint32_t>
+  GetEnabledChannelList (void) const
+  {
+    std::vector<uint32_t> enabled;
+    for (uint32_t c = 0; c < m_channels.size (); c++)
+      {
+        if (m_channels[c].enabled)
+          {
+            enabled.push_back (c);
+          }
+      }
+    return enabled;
+  }
+
+  uint32_t
+  GetSubBand (double frequencyMHz) const
+  {
+    for (uint32_t s = 0; s < m_subBands.size (); s++)
+      {
+        if (frequencyMHz > m_subBands[s].firstFrequencyMHz &&
+            frequencyMHz < m_subBands[s].lastFrequencyMHz)
+          {
+            return s;
+          }
+      }
+    return 0;
+  }
+
+  int64_t
+  GetWaitingTime (int64_t nowNs, uint32_t channel) const
+  {
+    int64_t waiting = m_subBands[GetSubBand (m_channels[channel].frequencyMHz)].nextNs - nowNs;
+    return waiting < 0 ? 0 : waiting;
+  }
+
+  std::vector<SubBand> m_subBands;
+  std::vector<Channel> m_channels;
+};
+
+/**
+ * An uplink attempt of the device.
+ */
+struct Attempt
+{
+  int64_t nowNs;
+  uint8_t dataRate;
+  double u;
+};
+
+/**
+ * Try to send each attempt: on the selected channel if there is one,
+ * otherwise record the waiting time. Returns the channel, or -1 minus the
+ * waiting time, per attempt.
+ */
+template <class Plan, class Tables>
+static void
+ReplayAttempts (Plan &plan, const std::vector<Attempt> &attempts, std::vector<int64_t> &results)
+{
+  for (uint32_t i = 0; i < attempts.size (); i++)
+    {
+      const Attempt &a = attempts[i];
+      int32_t channel = plan.Select (a.nowNs, a.dataRate, a.u);
+      if (channel < 0)
+        {
+          results[i] = -1 - plan.GetWaitingTimeForDataRate (a.nowNs, a.dataRate);
+        }
+      else
+        {
+          plan.AddEvent (a.nowNs, std::llround (Tables::timeOnAir[a.dataRate] * 1e9), channel);
+          results[i] = channel;
+        }
+    }
+}
+
+static int
+RunChannels (void)
+{
+  typedef LoraPhyTables<As923Profile, 23> Tables;
+  const double dutyCycle = 0.01;
+
+  // A custom plan on a 200 kHz raster from 915.2 MHz, split into sub-bands
+  // of consecutive channels as in program1
+  std::vector<std::pair<double, double>> subBands;
+  for (int s = 0; s < nSubBands; s++)
+    {
+      int first = s * nChannels / nSubBands;
+      int last = (s + 1) * nChannels / nSubBands - 1;
+      subBands.push_back (std::make_pair (915.1 + 0.2 * first, 915.3 + 0.2 * last));
+    }
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+  Ptr<ExponentialRandomVariable> interArrival = CreateObject<ExponentialRandomVariable> ();
+
+  // Uplink attempts offering `load` times what the duty cycles of all the
+  // sub-bands allow
+  double meanOnAir = 0;
+  for (int dr = 0; dr <= As923Profile::maxSfDataRate; dr++)
+    {
+      meanOnAir += Tables::timeOnAir[dr] / (As923Profile::maxSfDataRate + 1);
+    }
+  double meanInterArrival = meanOnAir / (dutyCycle * nSubBands * load);
+  std::vector<Attempt> attempts (nPackets);
+  double now = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      now += interArrival->GetValue (meanInterArrival, 0);
+      attempts[i].nowNs = std::llround (now * 1e9);
+      attempts[i].dataRate = uniform->GetInteger (0, As923Profile::maxSfDataRate);
+      attempts[i].u = uniform->GetValue (0, 1);
+    }
+
+  std::vector<int64_t> linearResults (nPackets);
+  double linearNs = TimePerOperation (
+      [&] () {
+        LinearChannelList plan;
+        for (int s = 0; s < nSubBands; s++)
+          {
+            plan.AddSubBand (subBands[s].first, subBands[s].second, dutyCycle);
+          }
+        for (int c = 0; c < nChannels; c++)
+          {
+            plan.AddChannel (915.2 + 0.2 * c, 0, As923Profile::maxSfDataRate);
+          }
+        ReplayAttempts<LinearChannelList, Tables> (plan, attempts, linearResults);
+      },
+      nPackets);
+
+  struct IndexedPlan : public ChannelAvailability
+  {
+    int64_t
+    GetWaitingTimeForDataRate (int64_t nowNs, uint8_t dataRate)
+    {
+      return GetWaitingTime (nowNs, dataRate);
+    }
+  };
+  std::vector<int64_t> indexedResults (nPackets);
+  double indexedNs = TimePerOperation (
+      [&] () {
+        IndexedPlan plan;
+        for (int s = 0; s < nSubBands; s++)
+          {
+            plan.AddSubBand (subBands[s].first, subBands[s].second, dutyCycle, 14);
+          }
+        for (int c = 0; c < nChannels; c++)
+          {
+            plan.AddChannel (915.2 + 0.2 * c, 0, As923Profile::maxSfDataRate);
+          }
+        ReplayAttempts<IndexedPlan, Tables> (plan, attempts, indexedResults);
+      },
+      nPackets);
+
+  uint32_t deferred = 0;
+  uint32_t mismatches = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      deferred += linearResults[i] < 0;
+      mismatches += linearResults[i] != indexedResults[i];
+    }
+
+  std::cout << "channels: " << nChannels << " channels in " << nSubBands << " sub-bands, "
+            << nPackets << " uplinks, load " << load << ", " << deferred
+            << " deferred by the duty cycle" << std::endl;
+  std::cout << "  channel lists:      " << linearNs << " ns/uplink" << std::endl;
+  std::cout << "  availability index: " << indexedNs << " ns/uplink" << std::endl;
+
+  if (mismatches > 0)
+    {
+      std::cerr << mismatches << " uplinks got a different channel or waiting time" << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+/**
+ * A confirmed uplink arriving at the network server.
+ */
+struct ConfirmedUplink
+{
+  int64_t tick; //!< Arrival, in ms
+  bool rx1Free; //!< Whether a gateway is free in RX1
+  int32_t supersedes; //!< Earlier uplink of the same device, or -1
+};
+
+/**
+ * Deadlines kept as the ns-3 MapScheduler keeps events: in a map ordered
+ * by time and insertion number.
+ */
+class DeadlineMap
+{
+public:
+  typedef std::pair<int64_t, uint64_t> Handle;
+
+  DeadlineMap ()
+      : m_inserted (0)
+  {
+  }
+
+  Handle
+  Schedule (int64_t tick, uint32_t value)
+  {
+    Handle key (tick, m_inserted++);
+    m_deadlines.insert (std::make_pair (key, value));
+    return key;
+  }
+
+  bool
+  Cancel (Handle handle)
+  {
+    return m_deadlines.erase (handle) > 0;
+  }
+
+  template <class F>
+  void
+  Advance (int64_t tick, F expire)
+  {
+    while (!m_deadlines.empty () && m_deadlines.begin ()->first.first <= tick)
+      {
+        std::pair<Handle, uint32_t> first = *m_deadlines.begin ();
+        m_deadlines.erase (m_deadlines.begin ());
+        expire (first.first.first, first.second);
+      }
+  }
+
+private:
+  std::map<Handle, uint32_t> m_deadlines;
+  uint64_t m_inserted;
+};
+
+/**
+ * Give each uplink its RX1 deadline a second after it arrives, and an RX2
+ * one a second later when no gateway is free in RX1; a retransmission
+ * cancels the deadline of the uplink it supersedes. Records every expired
+ * deadline as its tick and value, and every cancellation as -1 or -2.
+ */
+template <class Deadlines>
+static void
+ReplayUplinks (const std::vector<ConfirmedUplink> &uplinks, std::vector<int64_t> &results)
+{
+  Deadlines deadlines;
+  std::vector<typename Deadlines::Handle> pending (uplinks.size ());
+  results.clear ();
+  std::function<void (int64_t, uint32_t)> expire = [&] (int64_t tick, uint32_t value) {
+    results.push_back (tick);
+    results.push_back (value);
+    uint32_t i = value >> 1;
+    if ((value & 1) == 0 && !uplinks[i].rx1Free)
+      {
+        pending[i] = deadlines.Schedule (uplinks[i].tick + 2000, i << 1 | 1);
+      }
+  };
+  for (uint32_t i = 0; i < uplinks.size (); i++)
+    {
+      deadlines.Advance (uplinks[i].tick, expire);
+      if (uplinks[i].supersedes >= 0)
+        {
+          results.push_back (deadlines.Cancel (pending[uplinks[i].supersedes]) ? -1 : -2);
+        }
+      pending[i] = deadlines.Schedule (uplinks[i].tick + 1000, i << 1);
+    }
+  deadlines.Advance (std::numeric_limits<int64_t>::max () / 2, expire);
+}
+
+static int
+RunDeadlines (void)
+{
+  // Confirmed uplinks arriving `load` per ms, half of them answered in
+  // RX1, a tenth retransmissions of an uplink of the last three seconds
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+  Ptr<ExponentialRandomVariable> interArrival = CreateObject<ExponentialRandomVariable> ();
+  std::vector<ConfirmedUplink> uplinks (nPackets);
+  double now = 0;
+  for (int i = 0; i < nPackets; i++)
+    {
+      now += interArrival->GetValue (1 / load, 0);
+      uplinks[i].tick = int64_t (now);
+      uplinks[i].rx1Free = uniform->GetValue (0, 1) < 0.5;
+      int32_t back = uniform->GetInteger (1, uint32_t (3000 * load) + 1);
+      uplinks[i].supersedes = uniform->GetValue (0, 1) < 0.1 && back <= i ? i - back : -1;
+    }
+
+  std::vector<int64_t> mapResults;
+  double mapNs = TimePerOperation (
+      [&] () { ReplayUplinks<DeadlineMap> (uplinks, mapResults); }, nPackets);
+  std::vector<int64_t> wheelResults;
+  double wheelNs = TimePerOperation (
+      [&] () { ReplayUplinks<TimingWheel<uint32_t>> (uplinks, wheelResults); }, nPackets);
+
+  uint32_t cancelled = 0;
+  for (uint32_t i = 0; i < mapResults.size (); i++)
+    {
+      cancelled += mapResults[i] == -1;
+    }
+  std::cout << "deadlines: " << nPackets << " confirmed uplinks, " << load << " per ms, "
+            << cancelled << " deadlines cancelled" << std::endl;
+  std::cout << "  ordered map:  " << mapNs << " ns/uplink" << std::endl;
+  std::cout << "  timing wheel: " << wheelNs << " ns/uplink" << std::endl;
+
+  if (mapResults != wheelResults)
+    {
+      std::cerr << "The deadlines expired in a different order" << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+///////////////
+// Surrogate //
+///////////////
+
+static int
+RunSurrogate (void)
+{
+  typedef LoraPhyTables<Eu868Profile, 23> Tables;
+  const double dutyCycle = 0.01;
+  const double durationSeconds = 86400;
+
+  // Devices uniform over a disc around one gateway, with the log-distance
+  // loss of the area scenarios at 14 dBm
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+  std::vector<DeviceLink> links (nDevices);
+  for (int i = 0; i < nDevices; i++)
+    {
+      double distance = std::max (radius * std::sqrt (uniform->GetValue (0, 1)), 1.0);
+      links[i].gateway = 0;
+      links[i].rxPowerDbm = 14 - 35 - 32 * std::log10 (distance);
+    }
+
+  CapacitySurrogate<Eu868Profile, 23> estimator (nChannels, dutyCycle);
+  double buildNs = TimePerOperation ([&] () { estimator.Build (links, 1); }, 1);
+  SurrogatePrediction prediction;
+  double evaluateNs = TimePerOperation (
+      [&] () {
+        for (int k = 0; k < 1000; k++)
+          {
+            prediction = estimator.Evaluate (periodSeconds, durationSeconds);
+          }
+      },
+      1000);
+
+  // Every packet, at the data rate SetSpreadingFactorsUp gives its device,
+  // on a random channel, with the period stretched by the duty cycle
+  std::vector<InterferenceEvent> events;
+  for (int i = 0; i < nDevices; i++)
+    {
+      int dr = Eu868Profile::maxSfDataRate;
+      while (dr >= 0 && links[i].rxPowerDbm <= Tables::edSensitivity[dr])
+        {
+          dr--;
+        }
+      dr = std::max (dr, 0);
+      double timeOnAir = Tables::timeOnAir[dr];
+      double interval = std::max (periodSeconds, timeOnAir / dutyCycle);
+      for (double t = uniform->GetValue (0, interval); t < durationSeconds; t += interval)
+        {
+          InterferenceEvent event;
+          event.startNs = std::llround (t * 1e9);
+          event.endNs = event.startNs + std::llround (timeOnAir * 1e9);
+          event.rxPowerDbm = links[i].rxPowerDbm;
+          event.rxPowerW = DbmToW (event.rxPowerDbm);
+          event.sf = Eu868Profile::sf[dr];
+          event.channel = uniform->GetInteger (0, nChannels - 1);
+          events.push_back (event);
+        }
+    }
+  std::sort (events.begin (), events.end (),
+             [] (const InterferenceEvent &a, const InterferenceEvent &b) {
+               return a.startNs < b.startNs;
+             });
+
+  double sent[6] = {0, 0, 0, 0, 0, 0};
+  double delivered[6] = {0, 0, 0, 0, 0, 0};
+  int64_t maxDurationNs = std::llround (Tables::timeOnAir[0] * 1e9);
+  uint32_t first = 0;
+  uint32_t last = 0;
+  for (uint32_t i = 0; i < events.size (); i++)
+    {
+      int s = events[i].sf - 7;
+      sent[s]++;
+      if (events[i].rxPowerDbm < gwSensitivityDbm[s])
+        {
+          continue;
+        }
+      while (last < events.size () && events[last].startNs < events[i].endNs)
+        {
+          last++;
+        }
+      while (events[first].startNs + maxDurationNs < events[i].startNs)
+        {
+          first++;
+        }
+      delivered[s] += PerPacketInterference (events, first, last, i) == 0;
+    }
+
+  std::cout << "surrogate: " << nDevices << " devices within " << radius << " m, period "
+            << periodSeconds << " s, " << nChannels << " channels, " << events.size ()
+            << " packets replayed" << std::endl;
+  std::cout << "  build:    " << buildNs / 1000 << " us" << std::endl;
+  std::cout << "  evaluate: " << evaluateNs / 1000 << " us/point" << std::endl;
+  prediction.PrintComparison (std::cout, sent, delivered);
+
+  double predicted =
+      prediction.GetTotal (prediction.received) / prediction.GetTotal (prediction.sent);
+  double replayed = prediction.GetTotal (delivered) / prediction.GetTotal (sent);
+  if (std::fabs (predicted - replayed) > tolerance)
+    {
+      std::cerr << "The estimated delivery ratio is off by " << predicted - replayed << std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd;
+  cmd.AddValue ("case",
+                "Benchmark to run: reception-paths, interference, channels, deadlines or "
+                "surrogate",
+                benchCase);
+  cmd.AddValue ("paths", "Reception paths of the gateway", nPaths);
+  cmd.AddValue ("channels", "Channels the paths are spread over, or of the channel plan",
+                nChannels);
+  cmd.AddValue ("subBands", "Sub-bands the channel plan is split into", nSubBands);
+  cmd.AddValue ("devices", "Devices of the surrogate case", nDevices);
+  cmd.AddValue ("radius", "Radius in m of the area of the surrogate case", radius);
+  cmd.AddValue ("period", "Application period in s of the surrogate case", periodSeconds);
+  cmd.AddValue ("tolerance", "Largest delivery ratio error the surrogate case accepts",
+                tolerance);
+  cmd.AddValue ("packets", "Packets in the workload", nPackets);
+  cmd.AddValue ("load",
+                "Offered packets per reception path, or per channel, or fraction of the "
+                "duty cycle budget, or confirmed uplinks per ms",
+                load);
+  cmd.AddValue ("slice", "Width in ms of the batches of the interference case", sliceMs);
+  cmd.AddValue ("repetitions", "Timed runs of each implementation, the best is kept",
+                repetitions);
+  cmd.Parse (argc, argv);
+
+  if (benchCase == "reception-paths")
+    {
+      return RunReceptionPaths ();
+    }
+  if (benchCase == "interference")
+    {
+      return RunInterference ();
+    }
+  if (benchCase == "channels")
+    {
+      return RunChannels ();
+    }
+  if (benchCase == "deadlines")
+    {
+      return RunDeadlines ();
+    }
+  if (benchCase == "surrogate")
+    {
+      return RunSurrogate ();
+    }
+
+  std::cerr << "Unknown case " << benchCase << std::endl;
+  return 1;
+}
@@ -0,0 +1,34 @@
+/*
+ * This script decodes the binary event log written by the area scenarios
+ * (--eventLog) into one text line per event.
+ */
+
+#include "ns3/command-line.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "event-ring-log.h"
+
+using namespace ns3;
+using namespace lorawan;
+
+int
+main (int argc, char *argv[])
+{
+  std::string input = "scratch/events.bin";
+
+  CommandLine cmd;
+  cmd.AddValue ("input", "Binary event log to decode", input);
+  cmd.Parse (argc, argv);
+
+  std::ifstream in (input.c_str (), std::ios::binary);
+  if (!EventRingLog::Decode (in, std::cout))
+    {
+      std::cerr << input << " is not an event log of version " << EventRingLog::version
+                << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Compile-time LoRa PHY tables.
+ *
+ * The scenarios only ever send fixed-size application payloads over a
+ * handful of data rates, so the PHY quantities that the lorawan module
+ * computes per packet (time on air with pow/ceil, sensitivity lookups,
+ * SF x SF isolation) are generated here as constexpr tables, selected by
+ * region profile and payload size.
+ *
+ * Time on air follows LoraPhy::GetOnAirTime with the parameters set by
+ * ClassAEndDeviceLorawanMac: explicit header, CRC on, coding rate 4/5 and
+ * low data rate optimization for symbols longer than 16 ms.
+ */
+
+#ifndef LORA_PHY_TABLES_H
+#define LORA_PHY_TABLES_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+namespace ns3 {
+namespace lorawan {
+
+/**
+ * Data rate conversions shared by the EU868 and AS923 regions: DR0 to DR5
+ * are SF12 to SF7 at 125 kHz, DR6 is SF7 at 250 kHz.
+ */
+struct LoraDataRateProfile
+{
+  static constexpr int nDataRates = 7;
+  static constexpr uint8_t sf[nDataRates] = {12, 11, 10, 9, 8, 7, 7};
+  static constexpr double bandwidthHz[nDataRates] = {125000, 125000, 125000, 125000,
+                                                     125000, 125000, 250000};
+  static constexpr uint32_t nPreambleSymbols = 8;
+  // Highest data rate on a 125 kHz channel, used for SF assignment
+  static constexpr uint8_t maxSfDataRate = 5;
+};
+
+/**
+ * Data rate conversions of the EU868 region, as set by LorawanMacHelper.
+ */
+struct Eu868Profile : public LoraDataRateProfile
+{
+};
+
+/**
+ * Data rate conversions of ApplyCommonAS923Configurations in program1.cc.
+ */
+struct As923Profile : public LoraDataRateProfile
+{
+};
+
+// LorawanMacHeader (1 byte) plus LoraFrameHeader with FPort and no FOpts (8 bytes)
+constexpr uint32_t uplinkOverheadBytes = 9;
+
+// Sensitivities of EndDeviceLoraPhy and GatewayLoraPhy, from SF7 to SF12
+constexpr double edSensitivityDbm[6] = {-124, -127, -130, -133, -135, -137};
+constexpr double gwSensitivityDbm[6] = {-130.0, -132.5, -135.0, -137.5, -140.0, -142.5};
+
+// LoraInterferenceHelper's default (Goursaud) isolation matrix, signal SF
+// on the rows and interferer SF on the columns, from SF7 to SF12
+constexpr double sirIsolationDb[6][6] = {
+    // SF7  SF8  SF9  SF10 SF11 SF12
+    {6, -16, -18, -19, -19, -20}, // SF7
+    {-24, 6, -20, -22, -22, -22}, // SF8
+    {-27, -27, 6, -23, -25, -25}, // SF9
+    {-30, -30, -30, 6, -26, -28}, // SF10
+    {-33, -33, -33, -33, 6, -29}, // SF11
+    {-36, -36, -36, -36, -36, 6}}; // SF12
+
+/**
+ * Time on air in seconds, evaluated in the same order as
+ * LoraPhy::GetOnAirTime so that the result is the same double.
+ */
+constexpr double
+TimeOnAirSeconds (uint8_t sf, double bandwidthHz, uint32_t phyPayloadBytes,
+                  uint32_t nPreambleSymbols)
+{
+  double tSym = double (uint32_t (1) << sf) / bandwidthHz;
+  double tPreamble = (double (nPreambleSymbols) + 4.25) * tSym;
+
+  // Coding rate 4/5, CRC on, explicit header
+  int codingRate = 1;
+  int de = tSym > 0.016 ? 1 : 0;
+  int num = 8 * int (phyPayloadBytes) - 4 * int (sf) + 28 + 16;
+  int den = 4 * (int (sf) - 2 * de);
+
+  // Integer division truncates towards zero, which is ceil for num <= 0
+  int symbols = num > 0 ? (num + den - 1) / den : num / den;
+  int payloadSymbols = symbols * (codingRate + 4);
+  double payloadSymbNb = 8 + (payloadSymbols > 0 ? payloadSymbols : 0);
+
+  return tPreamble + payloadSymbNb * tSym;
+}
+
+template <class Region, std::size_t... Dr>
+constexpr std::array<double, Region::nDataRates>
+MakeTimeOnAirTable (uint32_t phyPayloadBytes, std::index_sequence<Dr...>)
+{
+  return {{TimeOnAirSeconds (Region::sf[Dr], Region::bandwidthHz[Dr], phyPayloadBytes,
+                             Region::nPreambleSymbols)...}};
+}
+
+template <class Region, std::size_t... Dr>
+constexpr std::array<double, Region::nDataRates>
+MakeSensitivityTable (const double (&perSf)[6], std::index_sequence<Dr...>)
+{
+  return {{perSf[Region::sf[Dr] - 7]...}};
+}
+
+/**
+ * Sensitivity and isolation lookup tables indexed by data rate.
+ */
+template <class Region>
+struct LoraRegionTables
+{
+  typedef std::make_index_sequence<Region::nDataRates> DataRates;
+
+  static constexpr std::array<double, Region::nDataRates> edSensitivity =
+      MakeSensitivityTable<Region> (edSensitivityDbm, DataRates ());
+
+  static constexpr std::array<double, Region::nDataRates> gwSensitivity =
+      MakeSensitivityTable<Region> (gwSensitivityDbm, DataRates ());
+
+  /**
+   * Minimum SIR (dB) for a packet at data rate dr to survive an
+   * interferer at data rate interfererDr.
+   */
+  static constexpr double
+  GetIsolation (uint8_t dr, uint8_t interfererDr)
+  {
+    return sirIsolationDb[Region::sf[dr] - 7][Region::sf[interfererDr] - 7];
+  }
+};
+
+/**
+ * Region tables plus time on air per data rate for a fixed application
+ * payload size.
+ */
+template <class Region, uint32_t AppPayloadBytes>
+struct LoraPhyTables : public LoraRegionTables<Region>
+{
+  static constexpr uint32_t phyPayloadBytes = AppPayloadBytes + uplinkOverheadBytes;
+
+  static constexpr std::array<double, Region::nDataRates> timeOnAir = MakeTimeOnAirTable<Region> (
+      phyPayloadBytes, typename LoraRegionTables<Region>::DataRates ());
+};
+
+// A 23 byte payload at SF7/125 kHz is 58 payload symbols: 71.936 ms on air
+static_assert (LoraPhyTables<Eu868Profile, 23>::timeOnAir[5] > 0.071935 &&
+                   LoraPhyTables<Eu868Profile, 23>::timeOnAir[5] < 0.071937,
+               "Unexpected SF7 time on air");
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* LORA_PHY_TABLES_H */
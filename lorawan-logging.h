@@ -0,0 +1,134 @@
+/*
+ * Compile-time maximum log levels for the lorawan components.
+ *
+ * EnableLorawanLogging replaces the list of LogComponentEnable calls the
+ * scenarios used to keep commented out: it enables every lorawan component
+ * at the requested level, clamped to a maximum level fixed at compile
+ * time, so the command line cannot turn on text formatting in the
+ * per-packet components of a production build.
+ *
+ * This only clamps what is enabled at run time. The NS_LOG statements
+ * compiled into the module are unchanged, and each of them still checks
+ * whether its component is enabled.
+ *
+ * The maximum levels can be overridden with -DLORAWAN_LOG_MAX_LEVEL=...
+ * and -DLORAWAN_LOG_HOT_PATH_MAX_LEVEL=... (ns3::LogLevel values).
+ */
+
+#ifndef LORAWAN_LOGGING_H
+#define LORAWAN_LOGGING_H
+
+#include "ns3/abort.h"
+#include "ns3/log.h"
+
+#include <string>
+
+#ifndef LORAWAN_LOG_MAX_LEVEL
+#ifdef NS3_LOG_ENABLE
+#define LORAWAN_LOG_MAX_LEVEL ns3::LOG_LEVEL_ALL
+#else
+#define LORAWAN_LOG_MAX_LEVEL ns3::LOG_NONE
+#endif
+#endif
+
+// Components that log for every packet at every receiver
+#ifndef LORAWAN_LOG_HOT_PATH_MAX_LEVEL
+#define LORAWAN_LOG_HOT_PATH_MAX_LEVEL (LORAWAN_LOG_MAX_LEVEL & ns3::LOG_LEVEL_INFO)
+#endif
+
+namespace ns3 {
+namespace lorawan {
+
+struct LorawanLogComponent
+{
+  const char *name;
+  int maxLevel;
+};
+
+constexpr LorawanLogComponent lorawanLogComponents[] = {
+    {"LoraChannel", LORAWAN_LOG_HOT_PATH_MAX_LEVEL},
+    {"LoraPhy", LORAWAN_LOG_HOT_PATH_MAX_LEVEL},
+    {"EndDeviceLoraPhy", LORAWAN_LOG_HOT_PATH_MAX_LEVEL},
+    {"GatewayLoraPhy", LORAWAN_LOG_HOT_PATH_MAX_LEVEL},
+    {"LoraInterferenceHelper", LORAWAN_LOG_HOT_PATH_MAX_LEVEL},
+    {"LorawanMac", LORAWAN_LOG_MAX_LEVEL},
+    {"EndDeviceLorawanMac", LORAWAN_LOG_MAX_LEVEL},
+    {"ClassAEndDeviceLorawanMac", LORAWAN_LOG_MAX_LEVEL},
+    {"GatewayLorawanMac", LORAWAN_LOG_MAX_LEVEL},
+    {"LogicalLoraChannelHelper", LORAWAN_LOG_MAX_LEVEL},
+    {"LogicalLoraChannel", LORAWAN_LOG_MAX_LEVEL},
+    {"LoraHelper", LORAWAN_LOG_MAX_LEVEL},
+    {"LoraPhyHelper", LORAWAN_LOG_MAX_LEVEL},
+    {"LorawanMacHelper", LORAWAN_LOG_MAX_LEVEL},
+    {"PeriodicSenderHelper", LORAWAN_LOG_MAX_LEVEL},
+    {"PeriodicSender", LORAWAN_LOG_MAX_LEVEL},
+    {"LorawanMacHeader", LORAWAN_LOG_MAX_LEVEL},
+    {"LoraFrameHeader", LORAWAN_LOG_MAX_LEVEL},
+    {"LoraPacketTracker", LORAWAN_LOG_MAX_LEVEL},
+    {"NetworkScheduler", LORAWAN_LOG_MAX_LEVEL},
+    {"NetworkServer", LORAWAN_LOG_MAX_LEVEL},
+    {"NetworkStatus", LORAWAN_LOG_MAX_LEVEL},
+    {"NetworkController", LORAWAN_LOG_MAX_LEVEL}};
+
+/**
+ * Parse none, error, warn, debug, info, function, logic or all, aborting
+ * on anything else.
+ */
+inline LogLevel
+ParseLorawanLogLevel (std::string level)
+{
+  if (level == "error")
+    {
+      return LOG_LEVEL_ERROR;
+    }
+  if (level == "warn")
+    {
+      return LOG_LEVEL_WARN;
+    }
+  if (level == "debug")
+    {
+      return LOG_LEVEL_DEBUG;
+    }
+  if (level == "info")
+    {
+      return LOG_LEVEL_INFO;
+    }
+  if (level == "function")
+    {
+      return LOG_LEVEL_FUNCTION;
+    }
+  if (level == "logic")
+    {
+      return LOG_LEVEL_LOGIC;
+    }
+  if (level == "all")
+    {
+      return LOG_LEVEL_ALL;
+    }
+  NS_ABORT_MSG_IF (level != "none",
+                   "Unknown log level " << level
+                                        << ", expected none, error, warn, debug, info, "
+                                           "function, logic or all");
+  return LOG_NONE;
+}
+
+/**
+ * Enable all lorawan components at level, clamped to their maximum levels.
+ */
+inline void
+EnableLorawanLogging (LogLevel level)
+{
+  for (const LorawanLogComponent &component : lorawanLogComponents)
+    {
+      int clamped = level & component.maxLevel;
+      if (clamped != 0)
+        {
+          LogComponentEnable (component.name, LogLevel (clamped));
+        }
+    }
+}
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* LORAWAN_LOGGING_H */
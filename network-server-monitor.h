@@ -0,0 +1,159 @@
+/*
+ * Per-device uplink accounting at the network server.
+ *
+ * Listens to the NetworkServer's ReceivedPacket trace, which fires once
+ * per gateway that forwarded an uplink. Devices are looked up in a flat
+ * DeviceRegistry by address, and copies of the same uplink coming from
+ * several gateways are folded together by an UplinkDedupTable sized to the
+ * number of uplinks in flight. Headers are read in place with an
+ * UplinkHeaderView, without copying the packet.
+ *
+ * This is accounting on top of the network server, not a faster path
+ * inside it: NetworkServer and NetworkStatus keep their own lookups, and
+ * every gateway copy costs the monitor one more registry and dedup table
+ * lookup. Scenarios install it only when asked to (--nsUplinks).
+ */
+
+#ifndef NETWORK_SERVER_MONITOR_H
+#define NETWORK_SERVER_MONITOR_H
+
+#include "device-registry.h"
+#include "uplink-header-view.h"
+
+#include "ns3/end-device-lorawan-mac.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/network-server.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+
+#include <ostream>
+
+namespace ns3 {
+namespace lorawan {
+
+class NetworkServerMonitor : public SimpleRefCount<NetworkServerMonitor>
+{
+public:
+  struct DeviceUplinks
+  {
+    DeviceUplinks ()
+        : nodeId (0),
+          uplinks (0),
+          copies (0)
+    {
+    }
+
+    uint32_t nodeId;
+    uint64_t uplinks; //!< Distinct uplinks received
+    uint64_t copies; //!< Copies received, one per gateway
+  };
+
+  /**
+   * \param window longest delay between two gateway copies of an uplink.
+   * \param inFlight expected number of distinct uplinks within a window.
+   */
+  NetworkServerMonitor (Time window, uint32_t inFlight)
+      : m_dedup (window, inFlight),
+        m_uplinks (0),
+        m_copies (0),
+        m_unknown (0)
+  {
+  }
+
+  NetworkServerMonitor (const NetworkServerMonitor &) = delete;
+  NetworkServerMonitor &operator= (const NetworkServerMonitor &) = delete;
+
+  /**
+   * Register the end devices, the same set given to NetworkServerHelper.
+   */
+  void
+  SetEndDevices (NodeContainer endDevices)
+  {
+    for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+      {
+        Ptr<EndDeviceLorawanMac> mac = (*i)
+                                           ->GetDevice (0)
+                                           ->GetObject<LoraNetDevice> ()
+                                           ->GetMac ()
+                                           ->GetObject<EndDeviceLorawanMac> ();
+        NS_ASSERT (mac != 0);
+        m_devices.Insert (mac->GetDeviceAddress ()).nodeId = (*i)->GetId ();
+      }
+  }
+
+  void
+  Install (Ptr<NetworkServer> networkServer)
+  {
+    networkServer->TraceConnectWithoutContext (
+        "ReceivedPacket", MakeCallback (&NetworkServerMonitor::OnReceivedPacket, this));
+  }
+
+  uint64_t
+  GetUplinks (void) const
+  {
+    return m_uplinks;
+  }
+
+  uint64_t
+  GetCopies (void) const
+  {
+    return m_copies;
+  }
+
+  /**
+   * Uplinks from addresses that were never registered.
+   */
+  uint64_t
+  GetUnknown (void) const
+  {
+    return m_unknown;
+  }
+
+  /**
+   * One line per device: node id, distinct uplinks, gateway copies.
+   */
+  void
+  Print (std::ostream &os) const
+  {
+    m_devices.ForEach ([&os] (LoraDeviceAddress address, const DeviceUplinks &d) {
+      os << d.nodeId << " " << address << " " << d.uplinks << " " << d.copies << std::endl;
+    });
+  }
+
+private:
+  void
+  OnReceivedPacket (Ptr<const Packet> packet)
+  {
+    UplinkHeaderView header;
+    if (!header.Parse (packet))
+      {
+        return;
+      }
+
+    DeviceUplinks *device = m_devices.Find (header.GetAddress ());
+    if (device == 0)
+      {
+        m_unknown++;
+        return;
+      }
+
+    m_copies++;
+    device->copies++;
+    if (m_dedup.Insert (header.GetAddress (), header.GetFCnt (), Simulator::Now ()))
+      {
+        m_uplinks++;
+        device->uplinks++;
+      }
+  }
+
+  DeviceRegistry<DeviceUplinks> m_devices;
+  UplinkDedupTable m_dedup;
+  uint64_t m_uplinks;
+  uint64_t m_copies;
+  uint64_t m_unknown;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* NETWORK_SERVER_MONITOR_H */
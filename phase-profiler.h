@@ -0,0 +1,272 @@
+/*
+ * Per-phase cost breakdown of a scenario run.
+ *
+ * Each phase records its wall time, the resident set size and the peak
+ * RSS at its end and, where perf_event_open is available (Linux with a
+ * permissive perf_event_paranoid), the CPU cycles, instructions and
+ * last-level cache misses of the process while it ran. The result is
+ * written as JSON so that runs of different builds and sizes can be
+ * compared by script.
+ *
+ * Phases are sequential: Begin () closes the running phase, if any.
+ */
+
+#ifndef PHASE_PROFILER_H
+#define PHASE_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ns3 {
+namespace lorawan {
+
+class PhaseProfiler
+{
+public:
+  enum Counter
+  {
+    CYCLES = 0,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    N_COUNTERS
+  };
+
+  PhaseProfiler ()
+      : m_enabled (false),
+        m_running (false)
+  {
+    for (int c = 0; c < N_COUNTERS; c++)
+      {
+        m_fd[c] = -1;
+      }
+  }
+
+  PhaseProfiler (const PhaseProfiler &) = delete;
+  PhaseProfiler &operator= (const PhaseProfiler &) = delete;
+
+  ~PhaseProfiler ()
+  {
+    for (int c = 0; c < N_COUNTERS; c++)
+      {
+        if (m_fd[c] >= 0)
+          {
+            close (m_fd[c]);
+          }
+      }
+  }
+
+  /**
+   * Profiling is off until enabled; Begin and End are then no-ops.
+   */
+  void
+  Enable (void)
+  {
+    m_enabled = true;
+#ifdef __linux__
+    m_fd[CYCLES] = OpenCounter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    m_fd[INSTRUCTIONS] = OpenCounter (PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    m_fd[LLC_MISSES] =
+        OpenCounter (PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+  }
+
+  void
+  Begin (const std::string &name)
+  {
+    if (!m_enabled)
+      {
+        return;
+      }
+    End ();
+
+    Phase phase;
+    phase.name = name;
+    m_phases.push_back (phase);
+    m_running = true;
+
+    for (int c = 0; c < N_COUNTERS; c++)
+      {
+        ControlCounter (c, true);
+      }
+    m_start = std::chrono::steady_clock::now ();
+  }
+
+  void
+  End (void)
+  {
+    if (!m_enabled || !m_running)
+      {
+        return;
+      }
+    std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now ();
+
+    Phase &phase = m_phases.back ();
+    for (int c = 0; c < N_COUNTERS; c++)
+      {
+        phase.counters[c] = ControlCounter (c, false);
+      }
+    phase.wallSeconds = std::chrono::duration<double> (stop - m_start).count ();
+    phase.rssKb = GetRssKb ();
+    phase.peakRssKb = GetPeakRssKb ();
+    m_running = false;
+  }
+
+  /**
+   * Write the phases as a JSON object. Counters that could not be opened
+   * are written as null.
+   */
+  void
+  WriteJson (const std::string &filename)
+  {
+    if (!m_enabled)
+      {
+        return;
+      }
+    End ();
+
+    static const char *counterNames[N_COUNTERS] = {"cycles", "instructions", "llc_misses"};
+
+    std::ofstream out (filename.c_str ());
+    double total = 0;
+    out << "{\n  \"phases\": [\n";
+    for (size_t i = 0; i < m_phases.size (); i++)
+      {
+        const Phase &p = m_phases[i];
+        total += p.wallSeconds;
+        out << "    {\"name\": \"" << p.name << "\", \"wall_s\": " << p.wallSeconds
+            << ", \"rss_kb\": " << p.rssKb << ", \"peak_rss_kb\": " << p.peakRssKb;
+        for (int c = 0; c < N_COUNTERS; c++)
+          {
+            out << ", \"" << counterNames[c] << "\": ";
+            if (m_fd[c] >= 0)
+              {
+                out << p.counters[c];
+              }
+            else
+              {
+                out << "null";
+              }
+          }
+        out << "}" << (i + 1 < m_phases.size () ? "," : "") << "\n";
+      }
+    out << "  ],\n  \"total_wall_s\": " << total << ",\n  \"peak_rss_kb\": " << GetPeakRssKb ()
+        << "\n}\n";
+  }
+
+  static long
+  GetPeakRssKb (void)
+  {
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    // Kilobytes on Linux
+    return usage.ru_maxrss;
+  }
+
+  static long
+  GetRssKb (void)
+  {
+    long pages = 0;
+    long resident = 0;
+    FILE *statm = fopen ("/proc/self/statm", "r");
+    if (statm == 0)
+      {
+        return 0;
+      }
+    if (fscanf (statm, "%ld %ld", &pages, &resident) != 2)
+      {
+        resident = 0;
+      }
+    fclose (statm);
+    return resident * (sysconf (_SC_PAGESIZE) / 1024);
+  }
+
+private:
+  struct Phase
+  {
+    Phase ()
+        : wallSeconds (0),
+          rssKb (0),
+          peakRssKb (0)
+    {
+      memset (counters, 0, sizeof (counters));
+    }
+
+    std::string name;
+    double wallSeconds;
+    long rssKb;
+    long peakRssKb;
+    uint64_t counters[N_COUNTERS];
+  };
+
+#ifdef __linux__
+  static int
+  OpenCounter (uint32_t type, uint64_t config)
+  {
+    struct perf_event_attr attr;
+    memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int (syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+
+  /**
+   * Reset and start a counter, or stop it and return its value.
+   */
+  uint64_t
+  ControlCounter (int c, bool start)
+  {
+    uint64_t value = 0;
+#ifdef __linux__
+    if (m_fd[c] < 0)
+      {
+        return 0;
+      }
+    if (start)
+      {
+        ioctl (m_fd[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl (m_fd[c], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    else
+      {
+        ioctl (m_fd[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read (m_fd[c], &value, sizeof (value)) != sizeof (value))
+          {
+            value = 0;
+          }
+      }
+#endif
+    return value;
+  }
+
+  bool m_enabled;
+  bool m_running;
+  int m_fd[N_COUNTERS];
+  std::chrono::steady_clock::time_point m_start;
+  std::vector<Phase> m_phases;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* PHASE_PROFILER_H */
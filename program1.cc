@@ -9,6 +9,7 @@
 #include "ns3/class-a-end-device-lorawan-mac.h"
 #include "ns3/gateway-lorawan-mac.h"
 
+#include "ns3/abort.h"
 #include "ns3/log.h"
 #include "ns3/pointer.h"
 #include "ns3/constant-position-mobility-model.h"
@@ -49,9 +50,13 @@
 #include <algorithm>
 #include <ctime>
 #include <fstream>
+#include <iterator>
  
 #include "ns3/gnuplot.h"
 
+#include "channel-availability.h"
+#include "lora-phy-tables.h"
+
 using namespace ns3;
 using namespace lorawan;
 
@@ -62,6 +67,52 @@ ObjectFactory m_phy;
 ObjectFactory m_mac;
 Ptr<LoraDeviceAddressGenerator> addrGen;
 
+// Gateway demodulator: reception paths, spread over the channels of the
+// plan
+int nReceptionPaths = 1;
+
+// Channel plan: up to 8 channels from the default table, or a custom plan
+// of up to 64 channels in 915-928 MHz split into nSubBands sub-bands
+int nChannels = 1;
+int nSubBands = 1;
+const double defaultChannels[] = {868.1, 868.3, 868.5, 867.1, 867.3, 867.5, 867.7, 867.9};
+ChannelAvailability channelPlan;
+
+static void BuildChannelPlan (void)
+{
+  if (nChannels <= int (std::size (defaultChannels)))
+    {
+      // The 865-868 MHz sub-band only when the plan has channels in it
+      channelPlan.AddSubBand (868, 868.6, 1, 14);
+      bool lowSubBand = false;
+      for (int c = 0; c < nChannels; c++)
+        {
+          lowSubBand = lowSubBand || defaultChannels[c] < 868;
+        }
+      if (lowSubBand)
+        {
+          channelPlan.AddSubBand (865, 868, 1, 14);
+        }
+      for (int c = 0; c < nChannels; c++)
+        {
+          channelPlan.AddChannel (defaultChannels[c], 0, 5);
+        }
+      return;
+    }
+
+  // 200 kHz raster from 915.2 MHz, split into sub-bands of consecutive
+  // channels with a 1% duty cycle each
+  for (int s = 0; s < nSubBands; s++)
+    {
+      int first = s * nChannels / nSubBands;
+      int last = (s + 1) * nChannels / nSubBands - 1;
+      channelPlan.AddSubBand (915.1 + 0.2 * first, 915.3 + 0.2 * last, 0.01, 14);
+    }
+  for (int c = 0; c < nChannels; c++)
+    {
+      channelPlan.AddChannel (915.2 + 0.2 * c, 0, 5);
+    }
+}
 
 static void ApplyCommonAS923Configurations (Ptr<LorawanMac> lorawanMac) 
 {
@@ -71,13 +122,23 @@ static void ApplyCommonAS923Configurations (Ptr<LorawanMac> lorawanMac)
   //////////////
 
   LogicalLoraChannelHelper channelHelper;
-  channelHelper.AddSubBand (868, 868.6, 1, 14);
+  for (uint32_t s = 0; s < channelPlan.GetNSubBands (); s++)
+    {
+      const ChannelAvailability::SubBand &subBand = channelPlan.GetSubBand (s);
+      channelHelper.AddSubBand (subBand.firstFrequencyMHz, subBand.lastFrequencyMHz,
+                                subBand.dutyCycle, subBand.maxTxPowerDbm);
+    }
 
   //////////////////////
   // Default channels //
   //////////////////////
-  Ptr<LogicalLoraChannel> lc1 = CreateObject<LogicalLoraChannel> (868.1, 0, 5);
-  channelHelper.AddChannel (lc1);
+  for (uint32_t c = 0; c < channelPlan.GetNChannels (); c++)
+    {
+      const ChannelAvailability::Channel &channel = channelPlan.GetChannel (c);
+      Ptr<LogicalLoraChannel> lc = CreateObject<LogicalLoraChannel> (
+          channel.frequencyMHz, channel.minDataRate, channel.maxDataRate);
+      channelHelper.AddChannel (lc);
+    }
 
   lorawanMac->SetLogicalLoraChannelHelper (channelHelper);
 
@@ -85,9 +146,11 @@ static void ApplyCommonAS923Configurations (Ptr<LorawanMac> lorawanMac)
   // DataRate -> SF, DataRate -> Bandwidth     //
   // and DataRate -> MaxAppPayload conversions //
   ///////////////////////////////////////////////
-  lorawanMac->SetSfForDataRate (std::vector<uint8_t>{12, 11, 10, 9, 8, 7, 7});
-  lorawanMac->SetBandwidthForDataRate (
-      std::vector<double>{125000, 125000, 125000, 125000, 125000, 125000, 250000});
+  // Taken from the profile the compile-time PHY tables are built on
+  lorawanMac->SetSfForDataRate (
+      std::vector<uint8_t> (std::begin (As923Profile::sf), std::end (As923Profile::sf)));
+  lorawanMac->SetBandwidthForDataRate (std::vector<double> (
+      std::begin (As923Profile::bandwidthHz), std::end (As923Profile::bandwidthHz)));
   lorawanMac->SetMaxAppPayloadForDataRate (
       std::vector<uint32_t>{59, 59, 59, 123, 230, 230, 230, 230});
 }
@@ -119,7 +182,7 @@ static void ConfigureForAS923Region (Ptr<ClassAEndDeviceLorawanMac> edMac)
   /////////////////////
   // Preamble length //
   /////////////////////
-  edMac->SetNPreambleSymbols (8);
+  edMac->SetNPreambleSymbols (As923Profile::nPreambleSymbols);
 
   //////////////////////////////////////
   // Second receive window parameters //
@@ -145,12 +208,15 @@ static void ConfigureForAS923Region (Ptr<GatewayLorawanMac> gwMac)
       gwPhy->ResetReceptionPaths ();
 
       std::vector<double> frequencies;
-      frequencies.push_back (868.1);
+      for (uint32_t c = 0; c < channelPlan.GetNChannels (); c++)
+        {
+          frequencies.push_back (channelPlan.GetChannel (c).frequencyMHz);
+        }
 
       std::vector<double>::iterator it = frequencies.begin ();
 
       int receptionPaths = 0;
-      int maxReceptionPaths = 1;
+      int maxReceptionPaths = nReceptionPaths;
       while (receptionPaths < maxReceptionPaths)
         {
           if (it == frequencies.end ())
@@ -170,9 +236,20 @@ main (int argc, char *argv[])
 {
 
   CommandLine cmd;
-  
+  cmd.AddValue ("receptionPaths", "Reception paths of the gateway (8, 16 or 64 for real gateways)",
+                nReceptionPaths);
+  cmd.AddValue ("channels",
+                "Channels of the plan the device and gateway use: 1 to 8 from the default "
+                "table, or 9 to 64 in a custom 915-928 MHz plan",
+                nChannels);
+  cmd.AddValue ("subBands", "Sub-bands of the custom plan", nSubBands);
   cmd.Parse (argc, argv);
 
+  NS_ABORT_MSG_IF (nChannels < 1 || nChannels > 64, "Plans have 1 to 64 channels");
+  NS_ABORT_MSG_IF (nSubBands < 1 || nSubBands > nChannels,
+                   "The custom plan has 1 to " << nChannels << " sub-bands");
+  BuildChannelPlan ();
+
   Ptr<Node> ned= CreateObject<Node>();
   Ptr<Node> ngw= CreateObject<Node>();
 
@@ -0,0 +1,197 @@
+/*
+ * Reception paths of a multi-path gateway, grouped by frequency.
+ *
+ * A gateway demodulator has a fixed number of paths, each locked to one
+ * frequency. Finding a free path for an incoming packet by walking the
+ * whole path list costs O(paths) per packet, which adds up for 16 and 64
+ * path gateways in dense multi-channel plans. Here every frequency keeps
+ * a bitmap of its free paths, so acquiring a path is a find-first-set on
+ * one word (for up to 64 paths per frequency) and releasing it clears one
+ * bit. A packet that finds no free path on its frequency is what the
+ * gateway counts as NO_MORE_RECEIVERS.
+ *
+ * Paths are numbered in the order they are added, as in
+ * GatewayLoraPhy::AddReceptionPath, and the lowest free path of a
+ * frequency is always the one acquired, so the allocation matches a walk
+ * of the path list in that order.
+ */
+
+#ifndef RECEPTION_PATH_POOL_H
+#define RECEPTION_PATH_POOL_H
+
+#include "ns3/assert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class ReceptionPathPool
+{
+public:
+  ReceptionPathPool ()
+  {
+    Reset ();
+  }
+
+  /**
+   * Remove all paths.
+   */
+  void
+  Reset (void)
+  {
+    m_groups.clear ();
+    m_paths.clear ();
+    m_groupOfChannel.clear ();
+  }
+
+  /**
+   * Add a free path locked to a frequency.
+   *
+   * \return the index of the path.
+   */
+  uint32_t
+  AddPath (double frequencyMHz)
+  {
+    uint32_t key = GetChannelKey (frequencyMHz);
+    int32_t g = FindGroup (key);
+    if (g < 0)
+      {
+        g = int32_t (m_groups.size ());
+        m_groups.push_back (Group ());
+        m_groupOfChannel.insert (
+            std::lower_bound (m_groupOfChannel.begin (), m_groupOfChannel.end (),
+                              std::make_pair (key, int32_t (-1))),
+            std::make_pair (key, g));
+      }
+
+    Group &group = m_groups[g];
+    uint32_t slot = group.paths.size ();
+    if (slot % 64 == 0)
+      {
+        group.free.push_back (0);
+      }
+    group.free[slot / 64] |= uint64_t (1) << (slot % 64);
+    group.nFree++;
+
+    uint32_t path = m_paths.size ();
+    group.paths.push_back (path);
+    m_paths.push_back (PathSlot{uint32_t (g), slot});
+    return path;
+  }
+
+  /**
+   * Lock the lowest free path of a frequency.
+   *
+   * \return the index of the path, or -1 if all paths of the frequency are
+   *         busy (or there are none).
+   */
+  int32_t
+  Acquire (double frequencyMHz)
+  {
+    int32_t g = FindGroup (GetChannelKey (frequencyMHz));
+    if (g < 0 || m_groups[g].nFree == 0)
+      {
+        return -1;
+      }
+
+    Group &group = m_groups[g];
+    uint32_t w = 0;
+    while (group.free[w] == 0)
+      {
+        w++;
+      }
+    uint32_t bit = __builtin_ctzll (group.free[w]);
+    group.free[w] &= group.free[w] - 1;
+    group.nFree--;
+    return int32_t (group.paths[w * 64 + bit]);
+  }
+
+  /**
+   * Free a path locked by Acquire.
+   */
+  void
+  Release (uint32_t path)
+  {
+    NS_ASSERT (path < m_paths.size ());
+    const PathSlot &p = m_paths[path];
+    Group &group = m_groups[p.group];
+    uint64_t mask = uint64_t (1) << (p.slot % 64);
+    NS_ASSERT_MSG ((group.free[p.slot / 64] & mask) == 0, "Path " << path << " is not busy");
+    group.free[p.slot / 64] |= mask;
+    group.nFree++;
+  }
+
+  /**
+   * \return the number of free paths on a frequency.
+   */
+  uint32_t
+  GetNFree (double frequencyMHz) const
+  {
+    int32_t g = FindGroup (GetChannelKey (frequencyMHz));
+    return g < 0 ? 0 : m_groups[g].nFree;
+  }
+
+  uint32_t
+  GetN (void) const
+  {
+    return m_paths.size ();
+  }
+
+private:
+  /**
+   * Channels are told apart to the kHz: 869.525 and 869.5 MHz are two
+   * channels.
+   */
+  static uint32_t
+  GetChannelKey (double frequencyMHz)
+  {
+    long key = std::lround (frequencyMHz * 1000);
+    NS_ASSERT_MSG (key >= 0, "Negative frequency " << frequencyMHz << " MHz");
+    return uint32_t (key);
+  }
+
+  /**
+   * \return the group of the paths of a channel, or -1. A binary search
+   *         over the few frequencies of the gateway.
+   */
+  int32_t
+  FindGroup (uint32_t key) const
+  {
+    std::vector<std::pair<uint32_t, int32_t>>::const_iterator it =
+        std::lower_bound (m_groupOfChannel.begin (), m_groupOfChannel.end (),
+                          std::make_pair (key, int32_t (-1)));
+    return it != m_groupOfChannel.end () && it->first == key ? it->second : -1;
+  }
+
+  struct Group
+  {
+    Group ()
+        : nFree (0)
+    {
+    }
+
+    std::vector<uint64_t> free;
+    std::vector<uint32_t> paths;
+    uint32_t nFree;
+  };
+
+  struct PathSlot
+  {
+    uint32_t group;
+    uint32_t slot;
+  };
+
+  std::vector<Group> m_groups;
+  std::vector<PathSlot> m_paths;
+  std::vector<std::pair<uint32_t, int32_t>> m_groupOfChannel; //!< kHz, group, by kHz
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* RECEPTION_PATH_POOL_H */
@@ -0,0 +1,413 @@
+/*
+ * Per-gateway, per-device, per-SF and per-time-bucket outcome tables.
+ *
+ * LoraPacketTracker answers one query per call by scanning its whole
+ * packet history, so a table for every gateway and every device costs a
+ * scan per row. This report instead counts every outcome once, as it
+ * happens, from the same trace sources the tracker listens to, into flat
+ * arrays indexed by gateway, device, spreading factor and time bucket.
+ * At the end all tables are written as CSV in one go.
+ *
+ * Outcomes are the tracker's PHY outcomes at each gateway (RECEIVED,
+ * INTERFERED, NO_MORE_RECEIVERS, UNDER_SENSITIVITY, LOST_BECAUSE_TX), the
+ * transmissions of the devices (SENT), and DELIVERED for an uplink
+ * received by the MAC of at least one gateway. Packets at the gateways are
+ * attributed to their device by the address in their header. Packets
+ * whose spreading factor is not 7 to 12 (a LoraTag that was never set)
+ * are counted in an "unknown" SF row rather than under any real SF.
+ */
+
+#ifndef RESULTS_REPORT_H
+#define RESULTS_REPORT_H
+
+#include "device-registry.h"
+#include "uplink-header-view.h"
+
+#include "ns3/end-device-lorawan-mac.h"
+#include "ns3/lora-net-device.h"
+#include "ns3/lora-tag.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+
+#include <cmath>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class ResultsReport
+{
+public:
+  enum Outcome
+  {
+    SENT = 0,
+    RECEIVED,
+    INTERFERED,
+    NO_MORE_RECEIVERS,
+    UNDER_SENSITIVITY,
+    LOST_BECAUSE_TX,
+    DELIVERED,
+    N_OUTCOMES
+  };
+
+  /**
+   * \param bucket width of the time buckets.
+   * \param stopTime end of the simulation, to size the time table.
+   */
+  ResultsReport (NodeContainer endDevices, NodeContainer gateways, Time bucket, Time stopTime)
+      : m_endDevices (endDevices),
+        m_gateways (gateways),
+        m_bucket (bucket),
+        m_deviceOfAddress (endDevices.GetN ())
+  {
+    for (uint32_t d = 0; d < endDevices.GetN (); d++)
+      {
+        Ptr<EndDeviceLorawanMac> mac = endDevices.Get (d)
+                                           ->GetDevice (0)
+                                           ->GetObject<LoraNetDevice> ()
+                                           ->GetMac ()
+                                           ->GetObject<EndDeviceLorawanMac> ();
+        m_macs.push_back (mac);
+        m_addresses.push_back (mac->GetDeviceAddress ());
+        m_deviceOfAddress.Insert (mac->GetDeviceAddress ()) = d;
+        SetIndex (m_deviceOfNode, endDevices.Get (d)->GetId (), d);
+      }
+    for (uint32_t g = 0; g < gateways.GetN (); g++)
+      {
+        SetIndex (m_gatewayOfNode, gateways.Get (g)->GetId (), g);
+      }
+
+    uint32_t nBuckets = uint32_t (std::ceil (stopTime.GetSeconds () / bucket.GetSeconds ())) + 1;
+    m_perGateway.assign (gateways.GetN () * N_OUTCOMES, 0);
+    m_perGatewaySf.assign (gateways.GetN () * N_SF_ROWS * N_OUTCOMES, 0);
+    m_perDevice.assign (endDevices.GetN () * N_OUTCOMES, 0);
+    m_perSf.assign (N_SF_ROWS * N_OUTCOMES, 0);
+    m_perBucket.assign (nBuckets * N_OUTCOMES, 0);
+    m_lastDelivered.assign (endDevices.GetN (), ~uint64_t (0));
+  }
+
+  ResultsReport (const ResultsReport &) = delete;
+  ResultsReport &operator= (const ResultsReport &) = delete;
+
+  /**
+   * Connect to the PHY traces of end devices and gateways, and to the
+   * gateway MACs.
+   */
+  void
+  Install (void)
+  {
+    for (NodeContainer::Iterator i = m_endDevices.Begin (); i != m_endDevices.End (); ++i)
+      {
+        Ptr<LoraPhy> phy = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ();
+        phy->TraceConnectWithoutContext ("StartSending",
+                                         MakeCallback (&ResultsReport::Sent, this));
+      }
+
+    for (NodeContainer::Iterator i = m_gateways.Begin (); i != m_gateways.End (); ++i)
+      {
+        Ptr<LoraNetDevice> device = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ();
+        Ptr<LoraPhy> phy = device->GetPhy ();
+        phy->TraceConnectWithoutContext ("ReceivedPacket",
+                                         MakeCallback (&ResultsReport::Received, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseInterference",
+                                         MakeCallback (&ResultsReport::Interfered, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseNoMoreReceivers",
+                                         MakeCallback (&ResultsReport::NoMoreReceivers, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseUnderSensitivity",
+                                         MakeCallback (&ResultsReport::UnderSensitivity, this));
+        phy->TraceConnectWithoutContext ("NoReceptionBecauseTransmitting",
+                                         MakeCallback (&ResultsReport::LostBecauseTx, this));
+        device->GetMac ()->TraceConnectWithoutContext (
+            "ReceivedPacket", MakeCallback (&ResultsReport::Delivered, this));
+      }
+  }
+
+  /**
+   * Account a packet that a device sent and that no gateway could hear,
+   * without it going through the PHY (see DeviceHibernation): lost because
+   * of transmitting at the gateways that were, under sensitivity at the
+   * others.
+   */
+  void
+  Hibernated (Ptr<const Packet> /* packet */, uint32_t endDeviceNodeId,
+              const std::vector<bool> &transmitting)
+  {
+    uint32_t d = m_deviceOfNode[endDeviceNodeId];
+    uint8_t sf = m_macs[d]->GetSfFromDataRate (m_macs[d]->GetDataRate ());
+    Count (SENT, d, NONE, sf);
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        Count (transmitting[g] ? LOST_BECAUSE_TX : UNDER_SENSITIVITY, d, g, sf);
+      }
+  }
+
+  /**
+   * \return the count of an outcome at a gateway.
+   */
+  uint64_t
+  GetGatewayCount (uint32_t gateway, Outcome outcome) const
+  {
+    return m_perGateway[gateway * N_OUTCOMES + outcome];
+  }
+
+  /**
+   * \return the count of an outcome over the whole network.
+   */
+  uint64_t
+  GetCount (Outcome outcome) const
+  {
+    uint64_t count = 0;
+    for (uint32_t sf = 0; sf < N_SF_ROWS; sf++)
+      {
+        count += m_perSf[sf * N_OUTCOMES + outcome];
+      }
+    return count;
+  }
+
+  /**
+   * \return the count of an outcome for one spreading factor, from 7 to 12.
+   */
+  uint64_t
+  GetSfCount (uint8_t sf, Outcome outcome) const
+  {
+    return m_perSf[(sf - 7) * N_OUTCOMES + outcome];
+  }
+
+  /**
+   * One line per gateway, in the column order of
+   * LoraPacketTracker::PrintPhyPacketsPerGw: node id, then SENT RECEIVED
+   * INTERFERED NO_MORE_RECEIVERS UNDER_SENSITIVITY LOST_BECAUSE_TX, SENT
+   * counting the transmissions of all devices.
+   */
+  void
+  PrintGateways (std::ostream &os) const
+  {
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        os << m_gateways.Get (g)->GetId () << " " << GetCount (SENT);
+        for (int o = RECEIVED; o <= LOST_BECAUSE_TX; o++)
+          {
+            os << " " << GetGatewayCount (g, Outcome (o));
+          }
+        os << std::endl;
+      }
+  }
+
+  /**
+   * Write <prefix>-gateways.csv, -gateways-sf.csv, -devices.csv, -sf.csv
+   * and -time.csv.
+   */
+  void
+  WriteCsv (std::string prefix) const
+  {
+    std::ofstream gateways ((prefix + "-gateways.csv").c_str ());
+    gateways << "gateway_node" << GetHeader (RECEIVED) << "\n";
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        gateways << m_gateways.Get (g)->GetId ();
+        WriteRow (gateways, &m_perGateway[g * N_OUTCOMES], RECEIVED);
+      }
+
+    std::ofstream gatewaysSf ((prefix + "-gateways-sf.csv").c_str ());
+    gatewaysSf << "gateway_node,sf" << GetHeader (RECEIVED) << "\n";
+    for (uint32_t g = 0; g < m_gateways.GetN (); g++)
+      {
+        for (uint32_t sf = 0; sf < N_SF_ROWS; sf++)
+          {
+            gatewaysSf << m_gateways.Get (g)->GetId () << "," << GetSfLabel (sf);
+            WriteRow (gatewaysSf, &m_perGatewaySf[(g * N_SF_ROWS + sf) * N_OUTCOMES],
+                      RECEIVED);
+          }
+      }
+
+    std::ofstream devices ((prefix + "-devices.csv").c_str ());
+    devices << "device_node,address" << GetHeader (SENT) << "\n";
+    for (uint32_t d = 0; d < m_endDevices.GetN (); d++)
+      {
+        devices << m_endDevices.Get (d)->GetId () << "," << m_addresses[d];
+        WriteRow (devices, &m_perDevice[d * N_OUTCOMES], SENT);
+      }
+
+    std::ofstream sfs ((prefix + "-sf.csv").c_str ());
+    sfs << "sf" << GetHeader (SENT) << "\n";
+    for (uint32_t sf = 0; sf < N_SF_ROWS; sf++)
+      {
+        sfs << GetSfLabel (sf);
+        WriteRow (sfs, &m_perSf[sf * N_OUTCOMES], SENT);
+      }
+
+    std::ofstream buckets ((prefix + "-time.csv").c_str ());
+    buckets << "start_s" << GetHeader (SENT) << "\n";
+    for (uint32_t b = 0; b < m_perBucket.size () / N_OUTCOMES; b++)
+      {
+        buckets << b * m_bucket.GetSeconds ();
+        WriteRow (buckets, &m_perBucket[b * N_OUTCOMES], SENT);
+      }
+  }
+
+private:
+  static const uint32_t NONE = ~uint32_t (0);
+  static const uint32_t UNKNOWN_SF = 6; //!< Row after SF7 to SF12, for any other SF
+  static const uint32_t N_SF_ROWS = 7;
+
+  static void
+  SetIndex (std::vector<uint32_t> &indexOfNode, uint32_t nodeId, uint32_t index)
+  {
+    if (nodeId >= indexOfNode.size ())
+      {
+        indexOfNode.resize (nodeId + 1, uint32_t (NONE));
+      }
+    indexOfNode[nodeId] = index;
+  }
+
+  static std::string
+  GetHeader (Outcome first)
+  {
+    static const char *names[N_OUTCOMES] = {"sent",
+                                            "received",
+                                            "interfered",
+                                            "no_more_receivers",
+                                            "under_sensitivity",
+                                            "lost_because_tx",
+                                            "delivered"};
+    std::string header;
+    for (int o = first; o < N_OUTCOMES; o++)
+      {
+        header += std::string (",") + names[o];
+      }
+    return header;
+  }
+
+  static std::string
+  GetSfLabel (uint32_t sfIndex)
+  {
+    return sfIndex == UNKNOWN_SF ? "unknown" : std::to_string (sfIndex + 7);
+  }
+
+  static void
+  WriteRow (std::ostream &os, const uint64_t *counts, Outcome first)
+  {
+    for (int o = first; o < N_OUTCOMES; o++)
+      {
+        os << "," << counts[o];
+      }
+    os << "\n";
+  }
+
+  void
+  Count (Outcome outcome, uint32_t device, uint32_t gateway, uint8_t sf)
+  {
+    uint32_t sfIndex = sf >= 7 && sf <= 12 ? sf - 7 : UNKNOWN_SF;
+    if (device != NONE)
+      {
+        m_perDevice[device * N_OUTCOMES + outcome]++;
+      }
+    if (gateway != NONE)
+      {
+        m_perGateway[gateway * N_OUTCOMES + outcome]++;
+        m_perGatewaySf[(gateway * N_SF_ROWS + sfIndex) * N_OUTCOMES + outcome]++;
+      }
+    m_perSf[sfIndex * N_OUTCOMES + outcome]++;
+
+    uint64_t b = uint64_t (Simulator::Now ().GetSeconds () / m_bucket.GetSeconds ());
+    if (b < m_perBucket.size () / N_OUTCOMES)
+      {
+        m_perBucket[b * N_OUTCOMES + outcome]++;
+      }
+  }
+
+  /**
+   * Count an outcome of a packet at a gateway.
+   */
+  void
+  CountAtGateway (Outcome outcome, Ptr<const Packet> packet, uint32_t gatewayNodeId)
+  {
+    UplinkHeaderView header;
+    uint32_t *device = header.Parse (packet) ? m_deviceOfAddress.Find (header.GetAddress ()) : 0;
+    LoraTag tag;
+    packet->PeekPacketTag (tag);
+    Count (outcome, device != 0 ? *device : NONE, m_gatewayOfNode[gatewayNodeId],
+           tag.GetSpreadingFactor ());
+  }
+
+  void
+  Sent (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    LoraTag tag;
+    packet->PeekPacketTag (tag);
+    Count (SENT, m_deviceOfNode[nodeId], NONE, tag.GetSpreadingFactor ());
+  }
+
+  void
+  Received (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    CountAtGateway (RECEIVED, packet, nodeId);
+  }
+
+  void
+  Interfered (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    CountAtGateway (INTERFERED, packet, nodeId);
+  }
+
+  void
+  NoMoreReceivers (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    CountAtGateway (NO_MORE_RECEIVERS, packet, nodeId);
+  }
+
+  void
+  UnderSensitivity (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    CountAtGateway (UNDER_SENSITIVITY, packet, nodeId);
+  }
+
+  void
+  LostBecauseTx (Ptr<const Packet> packet, uint32_t nodeId)
+  {
+    CountAtGateway (LOST_BECAUSE_TX, packet, nodeId);
+  }
+
+  /**
+   * A gateway MAC received an uplink: delivered the first time any
+   * gateway does.
+   */
+  void
+  Delivered (Ptr<const Packet> packet)
+  {
+    UplinkHeaderView header;
+    uint32_t *device = header.Parse (packet) ? m_deviceOfAddress.Find (header.GetAddress ()) : 0;
+    if (device == 0 || m_lastDelivered[*device] == packet->GetUid ())
+      {
+        return;
+      }
+    m_lastDelivered[*device] = packet->GetUid ();
+    LoraTag tag;
+    packet->PeekPacketTag (tag);
+    Count (DELIVERED, *device, NONE, tag.GetSpreadingFactor ());
+  }
+
+  NodeContainer m_endDevices;
+  NodeContainer m_gateways;
+  Time m_bucket;
+  std::vector<Ptr<EndDeviceLorawanMac>> m_macs;
+  std::vector<LoraDeviceAddress> m_addresses;
+  DeviceRegistry<uint32_t> m_deviceOfAddress;
+  std::vector<uint32_t> m_deviceOfNode;
+  std::vector<uint32_t> m_gatewayOfNode;
+
+  std::vector<uint64_t> m_perGateway;
+  std::vector<uint64_t> m_perGatewaySf;
+  std::vector<uint64_t> m_perDevice;
+  std::vector<uint64_t> m_perSf;
+  std::vector<uint64_t> m_perBucket;
+  std::vector<uint64_t> m_lastDelivered;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* RESULTS_REPORT_H */
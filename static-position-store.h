@@ -0,0 +1,187 @@
+/*
+ * Structure-of-arrays mirror of the positions of static nodes.
+ *
+ * Every node added to the store has its position copied into three
+ * contiguous arrays (x, y, z). The store listens to the CourseChange trace
+ * of each MobilityModel, so positions are only touched when a model
+ * notifies a change, and loops over many nodes (link budgets, nearest
+ * gateway searches) stream through plain memory instead of doing a virtual
+ * GetPosition () call per pair.
+ */
+
+#ifndef STATIC_POSITION_STORE_H
+#define STATIC_POSITION_STORE_H
+
+#include "ns3/callback.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node-container.h"
+#include "ns3/node.h"
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+class StaticPositionStore
+{
+public:
+  StaticPositionStore ()
+  {
+  }
+
+  // Registered as a trace sink through this pointer, so it must not move.
+  StaticPositionStore (const StaticPositionStore &) = delete;
+  StaticPositionStore &operator= (const StaticPositionStore &) = delete;
+
+  /**
+   * Mirror the positions of all nodes in the container. Every node needs
+   * an aggregated MobilityModel.
+   */
+  void
+  Add (NodeContainer nodes)
+  {
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        Ptr<MobilityModel> mobility = (*i)->GetObject<MobilityModel> ();
+        NS_ASSERT (mobility != 0);
+
+        uint32_t index = m_nodes.size ();
+        Vector pos = mobility->GetPosition ();
+        m_x.push_back (pos.x);
+        m_y.push_back (pos.y);
+        m_z.push_back (pos.z);
+        m_nodes.push_back (*i);
+        m_mobility.push_back (mobility);
+        m_index[PeekPointer (mobility)] = index;
+
+        mobility->TraceConnectWithoutContext (
+            "CourseChange", MakeCallback (&StaticPositionStore::CourseChanged, this));
+      }
+  }
+
+  /**
+   * Set a callback to be invoked with the store index of a node whose
+   * position changed.
+   */
+  void
+  SetChangeCallback (Callback<void, uint32_t> cb)
+  {
+    m_changeCallback = cb;
+  }
+
+  uint32_t
+  GetN (void) const
+  {
+    return m_nodes.size ();
+  }
+
+  Ptr<Node>
+  GetNode (uint32_t i) const
+  {
+    return m_nodes[i];
+  }
+
+  Ptr<MobilityModel>
+  GetMobility (uint32_t i) const
+  {
+    return m_mobility[i];
+  }
+
+  const double *
+  GetX (void) const
+  {
+    return m_x.data ();
+  }
+
+  const double *
+  GetY (void) const
+  {
+    return m_y.data ();
+  }
+
+  const double *
+  GetZ (void) const
+  {
+    return m_z.data ();
+  }
+
+  /**
+   * Squared distances from point (x, y, z) to every node in the store.
+   * The loop has no calls and no branches, so it vectorizes.
+   */
+  void
+  GetSquaredDistances (double x, double y, double z, double *out) const
+  {
+    const double *px = m_x.data ();
+    const double *py = m_y.data ();
+    const double *pz = m_z.data ();
+    uint32_t n = m_x.size ();
+    for (uint32_t i = 0; i < n; i++)
+      {
+        double dx = px[i] - x;
+        double dy = py[i] - y;
+        double dz = pz[i] - z;
+        out[i] = dx * dx + dy * dy + dz * dz;
+      }
+  }
+
+  /**
+   * Index of the node in this store nearest to (x, y, z).
+   */
+  uint32_t
+  FindNearest (double x, double y, double z) const
+  {
+    m_scratch.resize (m_x.size ());
+    GetSquaredDistances (x, y, z, m_scratch.data ());
+
+    uint32_t best = 0;
+    double bestDistance = std::numeric_limits<double>::max ();
+    for (uint32_t i = 0; i < m_scratch.size (); i++)
+      {
+        if (m_scratch[i] < bestDistance)
+          {
+            bestDistance = m_scratch[i];
+            best = i;
+          }
+      }
+    return best;
+  }
+
+private:
+  void
+  CourseChanged (Ptr<const MobilityModel> model)
+  {
+    std::unordered_map<const MobilityModel *, uint32_t>::const_iterator it =
+        m_index.find (PeekPointer (model));
+    if (it == m_index.end ())
+      {
+        return;
+      }
+
+    Vector pos = model->GetPosition ();
+    m_x[it->second] = pos.x;
+    m_y[it->second] = pos.y;
+    m_z[it->second] = pos.z;
+
+    if (!m_changeCallback.IsNull ())
+      {
+        m_changeCallback (it->second);
+      }
+  }
+
+  std::vector<double> m_x;
+  std::vector<double> m_y;
+  std::vector<double> m_z;
+  std::vector<Ptr<Node>> m_nodes;
+  std::vector<Ptr<MobilityModel>> m_mobility;
+  std::unordered_map<const MobilityModel *, uint32_t> m_index;
+  Callback<void, uint32_t> m_changeCallback;
+  mutable std::vector<double> m_scratch;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* STATIC_POSITION_STORE_H */
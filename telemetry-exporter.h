@@ -0,0 +1,295 @@
+/*
+ * Live progress of a running simulation, as a Prometheus text file.
+ *
+ * The simulation thread only bumps relaxed atomic counters from the PHY,
+ * MAC and network server trace sources, and samples the simulated time
+ * and the executed event count from an event of its own, every sampling
+ * period of simulated time, so they advance even through stretches
+ * without packets. That event reschedules itself, so the run must end
+ * with Simulator::Stop, and its own executions are left out of the
+ * exported event count, which is the simulation's alone. A background
+ * thread rewrites the metrics file on a wall clock period, through a
+ * temporary file and a rename, so readers (a node exporter textfile
+ * collector, or a plain cat) never see a partial file; a failed write is
+ * reported on stderr. A worker whose simulated time stops advancing, or
+ * whose RSS keeps growing, shows up without waiting for the end of the
+ * run.
+ */
+
+#ifndef TELEMETRY_EXPORTER_H
+#define TELEMETRY_EXPORTER_H
+
+#include "phase-profiler.h"
+
+#include "ns3/lora-net-device.h"
+#include "ns3/network-server.h"
+#include "ns3/node-container.h"
+#include "ns3/simulator.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ns3 {
+namespace lorawan {
+
+class TelemetryExporter
+{
+public:
+  enum Counter
+  {
+    TX_STARTED = 0,
+    RECEIVED,
+    INTERFERED,
+    NO_MORE_RECEIVERS,
+    UNDER_SENSITIVITY,
+    LOST_BECAUSE_TX,
+    NS_RECEIVED,
+    N_COUNTERS
+  };
+
+  TelemetryExporter ()
+      : m_simTimeNs (0),
+        m_events (0),
+        m_samples (0),
+        m_stop (false),
+        m_writeFailed (false)
+  {
+    for (int c = 0; c < N_COUNTERS; c++)
+      {
+        m_counters[c] = 0;
+      }
+  }
+
+  TelemetryExporter (const TelemetryExporter &) = delete;
+  TelemetryExporter &operator= (const TelemetryExporter &) = delete;
+
+  ~TelemetryExporter ()
+  {
+    Stop ();
+  }
+
+  /**
+   * Connect to the PHY traces of end devices and gateways and to the
+   * network server.
+   */
+  void
+  Install (NodeContainer endDevices, NodeContainer gateways, Ptr<NetworkServer> networkServer)
+  {
+    for (NodeContainer::Iterator i = endDevices.Begin (); i != endDevices.End (); ++i)
+      {
+        Ptr<LoraPhy> phy = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ();
+        phy->TraceConnectWithoutContext ("StartSending",
+                                         MakeCallback (&TelemetryExporter::TxStarted, this));
+      }
+
+    for (NodeContainer::Iterator i = gateways.Begin (); i != gateways.End (); ++i)
+      {
+        Ptr<LoraPhy> phy = (*i)->GetDevice (0)->GetObject<LoraNetDevice> ()->GetPhy ();
+        phy->TraceConnectWithoutContext ("ReceivedPacket",
+                                         MakeCallback (&TelemetryExporter::Received, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseInterference",
+                                         MakeCallback (&TelemetryExporter::Interfered, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseNoMoreReceivers",
+                                         MakeCallback (&TelemetryExporter::NoMoreReceivers, this));
+        phy->TraceConnectWithoutContext ("LostPacketBecauseUnderSensitivity",
+                                         MakeCallback (&TelemetryExporter::UnderSensitivity, this));
+        phy->TraceConnectWithoutContext ("NoReceptionBecauseTransmitting",
+                                         MakeCallback (&TelemetryExporter::LostBecauseTx, this));
+      }
+
+    if (networkServer != 0)
+      {
+        networkServer->TraceConnectWithoutContext (
+            "ReceivedPacket", MakeCallback (&TelemetryExporter::NsReceived, this));
+      }
+  }
+
+  /**
+   * Start rewriting the metrics file every period of wall clock time, and
+   * sampling the simulated time and event count every samplePeriod of
+   * simulated time.
+   */
+  void
+  Start (std::string filename, double periodSeconds, Time samplePeriod = Seconds (1))
+  {
+    m_samplePeriod = samplePeriod;
+    Record ();
+    Simulator::Schedule (m_samplePeriod, &TelemetryExporter::Sample, this);
+    m_filename = filename;
+    m_start = std::chrono::steady_clock::now ();
+    m_thread = std::thread (&TelemetryExporter::Export, this,
+                            std::chrono::duration<double> (periodSeconds));
+  }
+
+  /**
+   * Write a last snapshot and stop the background thread.
+   */
+  void
+  Stop (void)
+  {
+    if (!m_thread.joinable ())
+      {
+        return;
+      }
+    {
+      std::lock_guard<std::mutex> lock (m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one ();
+    m_thread.join ();
+  }
+
+private:
+  void
+  Count (Counter c)
+  {
+    m_counters[c].fetch_add (1, std::memory_order_relaxed);
+  }
+
+  void
+  Record (void)
+  {
+    m_simTimeNs.store (Simulator::Now ().GetNanoSeconds (), std::memory_order_relaxed);
+    m_events.store (Simulator::GetEventCount () - m_samples, std::memory_order_relaxed);
+  }
+
+  void
+  Sample (void)
+  {
+    // The simulator counts this event before running it
+    m_samples++;
+    Record ();
+    Simulator::Schedule (m_samplePeriod, &TelemetryExporter::Sample, this);
+  }
+
+  void
+  TxStarted (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (TX_STARTED);
+  }
+
+  void
+  Received (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (RECEIVED);
+  }
+
+  void
+  Interfered (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (INTERFERED);
+  }
+
+  void
+  NoMoreReceivers (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (NO_MORE_RECEIVERS);
+  }
+
+  void
+  UnderSensitivity (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (UNDER_SENSITIVITY);
+  }
+
+  void
+  LostBecauseTx (Ptr<const Packet> /* packet */, uint32_t /* nodeId */)
+  {
+    Count (LOST_BECAUSE_TX);
+  }
+
+  void
+  NsReceived (Ptr<const Packet> /* packet */)
+  {
+    Count (NS_RECEIVED);
+  }
+
+  void
+  Export (std::chrono::duration<double> period)
+  {
+    uint64_t lastEvents = 0;
+    std::chrono::steady_clock::time_point last = m_start;
+    std::unique_lock<std::mutex> lock (m_mutex);
+    bool stopping = false;
+    while (!stopping)
+      {
+        stopping = m_wake.wait_for (lock, period, [this] () { return m_stop; });
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
+        uint64_t events = m_events.load (std::memory_order_relaxed);
+        double elapsed = std::chrono::duration<double> (now - last).count ();
+        double rate = elapsed > 0 ? (events - lastEvents) / elapsed : 0;
+        Write (std::chrono::duration<double> (now - m_start).count (), events, rate);
+        last = now;
+        lastEvents = events;
+      }
+  }
+
+  void
+  Write (double wallSeconds, uint64_t events, double eventsPerSecond)
+  {
+    static const char *counterNames[N_COUNTERS] = {
+        "tx_started",        "received",        "interfered", "no_more_receivers",
+        "under_sensitivity", "lost_because_tx", "ns_received"};
+
+    std::string temporary = m_filename + ".tmp";
+    bool written;
+    {
+      std::ofstream out (temporary.c_str (), std::ios::trunc);
+      out << "# TYPE lorawan_sim_time_seconds gauge\n"
+          << "lorawan_sim_time_seconds " << m_simTimeNs.load (std::memory_order_relaxed) * 1e-9
+          << "\n# TYPE lorawan_wall_time_seconds gauge\n"
+          << "lorawan_wall_time_seconds " << wallSeconds
+          << "\n# TYPE lorawan_sim_events_total counter\n"
+          << "lorawan_sim_events_total " << events
+          << "\n# TYPE lorawan_sim_events_per_second gauge\n"
+          << "lorawan_sim_events_per_second " << eventsPerSecond
+          << "\n# TYPE lorawan_process_resident_memory_bytes gauge\n"
+          << "lorawan_process_resident_memory_bytes " << PhaseProfiler::GetRssKb () * 1024
+          << "\n# TYPE lorawan_packets_total counter\n";
+      for (int c = 0; c < N_COUNTERS; c++)
+        {
+          out << "lorawan_packets_total{event=\"" << counterNames[c] << "\"} "
+              << m_counters[c].load (std::memory_order_relaxed) << "\n";
+        }
+      out.flush ();
+      written = bool (out);
+    }
+    bool failed = !written || std::rename (temporary.c_str (), m_filename.c_str ()) != 0;
+    if (failed && !m_writeFailed)
+      {
+        std::cerr << "Could not write telemetry to " << m_filename << std::endl;
+      }
+    else if (!failed && m_writeFailed)
+      {
+        std::cerr << "Telemetry written to " << m_filename << " again" << std::endl;
+      }
+    m_writeFailed = failed;
+  }
+
+  std::atomic<uint64_t> m_counters[N_COUNTERS];
+  std::atomic<int64_t> m_simTimeNs;
+  std::atomic<uint64_t> m_events;
+  uint64_t m_samples; //!< Sample events executed, to leave out of m_events
+
+  std::string m_filename;
+  std::chrono::steady_clock::time_point m_start;
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop;
+  bool m_writeFailed; //!< Whether the last write failed, to report changes only
+  Time m_samplePeriod;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* TELEMETRY_EXPORTER_H */
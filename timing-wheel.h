@@ -0,0 +1,364 @@
+/*
+ * Hierarchical timing wheel, for large numbers of short-lived deadlines.
+ *
+ * Every confirmed uplink gives the network server two deadlines, the
+ * openings of the device's RX1 and RX2 windows, most of which are
+ * cancelled or expire within two seconds. Kept in the simulator's event
+ * set (or any ordered map or heap), each of them costs O(log n) to insert
+ * and again to remove, with n the number of uplinks in flight.
+ *
+ * Here deadlines are integer ticks in four levels of 64 slots each: a
+ * deadline goes to the lowest level whose slot range still contains it,
+ * as seen from the current tick, and moves down a level when the wheel
+ * reaches its slot. Scheduling and cancelling are O(1), and advancing
+ * jumps straight to the next non-empty slot through a bitmap of occupied
+ * slots per level, so idle stretches cost nothing. Deadlines further than
+ * 64^4 ticks away wait in an overflow list.
+ *
+ * Deadlines of the same tick expire in the order they were scheduled, as
+ * events of the same time do in the ns-3 schedulers.
+ *
+ * No scenario uses it yet: the network server creates its NetworkScheduler
+ * itself and schedules the receive windows as simulator events, so taking
+ * them over needs changes to the lorawan module. Only lora-bench
+ * --case=deadlines runs it, against an ordered map.
+ */
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include "ns3/assert.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace ns3 {
+namespace lorawan {
+
+template <class T>
+class TimingWheel
+{
+public:
+  typedef uint64_t Handle;
+
+  TimingWheel ()
+      : m_now (0),
+        m_round (0),
+        m_free (nil),
+        m_size (0)
+  {
+    for (uint32_t l = 0; l < nLevels; l++)
+      {
+        m_occupied[l] = 0;
+      }
+    for (uint32_t s = 0; s < nLists; s++)
+      {
+        m_head[s] = m_tail[s] = nil;
+      }
+  }
+
+  /**
+   * Schedule a value to expire at a tick. A tick already reached expires
+   * at the next Advance.
+   *
+   * \return a handle to cancel it.
+   */
+  Handle
+  Schedule (int64_t tick, const T &value)
+  {
+    uint32_t n;
+    if (m_free != nil)
+      {
+        n = m_free;
+        m_free = m_nodes[n].next;
+      }
+    else
+      {
+        n = m_nodes.size ();
+        m_nodes.push_back (Node ());
+      }
+    Node &node = m_nodes[n];
+    node.tick = tick < m_now ? m_now : tick;
+    node.value = value;
+    node.generation++;
+    Place (n);
+    m_size++;
+    return (Handle (node.generation) << 32) | n;
+  }
+
+  /**
+   * Cancel a scheduled value.
+   *
+   * \return false if it already expired or was cancelled.
+   */
+  bool
+  Cancel (Handle handle)
+  {
+    uint32_t n = uint32_t (handle);
+    if (n >= m_nodes.size () || m_nodes[n].generation != uint32_t (handle >> 32) ||
+        m_nodes[n].list == nil)
+      {
+        return false;
+      }
+    Unlink (n);
+    Release (n);
+    return true;
+  }
+
+  /**
+   * Expire, in tick order, every value scheduled up to a tick, calling
+   * expire (tick, value) for each. The callback may schedule and cancel.
+   */
+  template <class F>
+  void
+  Advance (int64_t tick, F expire)
+  {
+    while (true)
+      {
+        int64_t next;
+        uint32_t level = GetNextSlot (next);
+        if (level == nil || next > tick)
+          {
+            break;
+          }
+        m_now = next;
+        if (level > 0)
+          {
+            MoveDown (level);
+            continue;
+          }
+
+        uint32_t list = GetSlot (next, 0);
+        while (m_head[list] != nil)
+          {
+            uint32_t n = m_head[list];
+            Unlink (n);
+            T value = m_nodes[n].value;
+            Release (n);
+            expire (next, value);
+          }
+        m_now = next + 1;
+      }
+    if (tick >= m_now)
+      {
+        m_now = tick + 1;
+      }
+
+    // Move down the slots the wheel entered without reaching their first
+    // tick, before anything is scheduled next to them
+    int64_t next;
+    uint32_t level = GetNextSlot (next);
+    while (level != nil && level > 0 && next == m_now)
+      {
+        MoveDown (level);
+        level = GetNextSlot (next);
+      }
+  }
+
+  /**
+   * \return the number of values scheduled.
+   */
+  uint32_t
+  GetSize (void) const
+  {
+    return m_size;
+  }
+
+private:
+  static const uint32_t nLevels = 4;
+  static const uint32_t overflow = nLevels * 64; //!< List of the overflow deadlines
+  static const uint32_t nLists = overflow + 1;
+  static const uint32_t nil = ~uint32_t (0);
+
+  struct Node
+  {
+    Node ()
+        : tick (0),
+          generation (0),
+          list (nil),
+          prev (nil),
+          next (nil)
+    {
+    }
+
+    int64_t tick;
+    T value;
+    uint32_t generation;
+    uint32_t list;
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  static uint32_t
+  GetSlot (int64_t tick, uint32_t level)
+  {
+    return uint32_t (tick >> (6 * level)) & 63;
+  }
+
+  /**
+   * Append a node to the list of the lowest level whose current round
+   * contains its tick.
+   */
+  void
+  Place (uint32_t n)
+  {
+    int64_t tick = m_nodes[n].tick;
+    uint32_t list = overflow;
+    for (uint32_t level = 0; level < nLevels; level++)
+      {
+        if ((tick >> (6 * (level + 1))) == (m_now >> (6 * (level + 1))))
+          {
+            list = level * 64 + GetSlot (tick, level);
+            m_occupied[level] |= uint64_t (1) << GetSlot (tick, level);
+            break;
+          }
+      }
+
+    Node &node = m_nodes[n];
+    node.list = list;
+    node.prev = m_tail[list];
+    node.next = nil;
+    if (m_tail[list] != nil)
+      {
+        m_nodes[m_tail[list]].next = n;
+      }
+    else
+      {
+        m_head[list] = n;
+      }
+    m_tail[list] = n;
+  }
+
+  void
+  Unlink (uint32_t n)
+  {
+    Node &node = m_nodes[n];
+    uint32_t list = node.list;
+    if (node.prev != nil)
+      {
+        m_nodes[node.prev].next = node.next;
+      }
+    else
+      {
+        m_head[list] = node.next;
+      }
+    if (node.next != nil)
+      {
+        m_nodes[node.next].prev = node.prev;
+      }
+    else
+      {
+        m_tail[list] = node.prev;
+      }
+    if (m_head[list] == nil && list != overflow)
+      {
+        m_occupied[list / 64] &= ~(uint64_t (1) << (list % 64));
+      }
+    node.list = nil;
+  }
+
+  void
+  ClearList (uint32_t list)
+  {
+    m_head[list] = m_tail[list] = nil;
+    if (list != overflow)
+      {
+        m_occupied[list / 64] &= ~(uint64_t (1) << (list % 64));
+      }
+  }
+
+  /**
+   * Place again the nodes of the current slot of a level, or of the
+   * overflow list, now that the wheel is in their round.
+   */
+  void
+  MoveDown (uint32_t level)
+  {
+    uint32_t list = overflow;
+    if (level < nLevels)
+      {
+        list = level * 64 + GetSlot (m_now, level);
+      }
+    else
+      {
+        m_round = m_now >> (6 * nLevels);
+      }
+    uint32_t n = m_head[list];
+    ClearList (list);
+    while (n != nil)
+      {
+        uint32_t following = m_nodes[n].next;
+        Place (n);
+        n = following;
+      }
+  }
+
+  void
+  Release (uint32_t n)
+  {
+    m_nodes[n].list = nil;
+    m_nodes[n].next = m_free;
+    m_free = n;
+    m_size--;
+  }
+
+  /**
+   * Find the next slot to visit: a level 0 slot to expire, or a higher
+   * level slot to move down, whichever comes first.
+   *
+   * \return its level (nLevels for the overflow list), or nil if the
+   *         wheel is empty.
+   */
+  uint32_t
+  GetNextSlot (int64_t &tick) const
+  {
+    // Slots the wheel has entered since its last move, from the top: they
+    // go down before anything below them expires
+    if (m_head[overflow] != nil && (m_now >> (6 * nLevels)) != m_round)
+      {
+        tick = m_now;
+        return nLevels;
+      }
+    for (uint32_t level = nLevels - 1; level > 0; level--)
+      {
+        if (m_occupied[level] & (uint64_t (1) << GetSlot (m_now, level)))
+          {
+            tick = m_now;
+            return level;
+          }
+      }
+
+    for (uint32_t level = 0; level < nLevels; level++)
+      {
+        uint32_t current = GetSlot (m_now, level);
+        uint64_t pending = m_occupied[level] >> current;
+        if (pending != 0)
+          {
+            uint32_t slot = current + __builtin_ctzll (pending);
+            int64_t round = (m_now >> (6 * (level + 1))) << (6 * (level + 1));
+            tick = round + (int64_t (slot) << (6 * level));
+            return level;
+          }
+      }
+    if (m_head[overflow] != nil)
+      {
+        tick = ((m_now >> (6 * nLevels)) + 1) << (6 * nLevels);
+        return nLevels;
+      }
+    return nil;
+  }
+
+  int64_t m_now; //!< First tick not expired yet
+  int64_t m_round; //!< Top level round the overflow list was last moved down in
+  std::vector<Node> m_nodes;
+  uint32_t m_free;
+  uint32_t m_size;
+  uint64_t m_occupied[nLevels];
+  uint32_t m_head[nLists];
+  uint32_t m_tail[nLists];
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* TIMING_WHEEL_H */
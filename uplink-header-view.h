@@ -0,0 +1,108 @@
+/*
+ * Read-only view of the LoRaWAN headers at the start of an uplink.
+ *
+ * Reading the device address and frame counter with RemoveHeader needs a
+ * writable copy of the packet for every gateway copy of every uplink. The
+ * fields the network server side needs all sit in the first eight bytes
+ * (MHDR, DevAddr, FCtrl, FCnt), so they are read here with one CopyData
+ * into a stack buffer, leaving the shared packet untouched.
+ *
+ * The layout is the one written by LorawanMacHeader and LoraFrameHeader:
+ * multi-byte fields little endian, as Buffer::Iterator::WriteU16/U32.
+ */
+
+#ifndef UPLINK_HEADER_VIEW_H
+#define UPLINK_HEADER_VIEW_H
+
+#include "ns3/lora-device-address.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/packet.h"
+
+#include <cstdint>
+
+namespace ns3 {
+namespace lorawan {
+
+class UplinkHeaderView
+{
+public:
+  UplinkHeaderView ()
+      : m_valid (false)
+  {
+  }
+
+  /**
+   * \param downlink read a downlink data frame instead, whose headers have
+   *        the same layout.
+   * \return false unless the packet starts with the headers of an uplink
+   *         data frame (of a downlink one with downlink set).
+   */
+  bool
+  Parse (Ptr<const Packet> packet, bool downlink = false)
+  {
+    m_valid = packet->CopyData (m_bytes, sizeof (m_bytes)) == sizeof (m_bytes);
+    if (downlink)
+      {
+        m_valid = m_valid && (GetMType () == LorawanMacHeader::UNCONFIRMED_DATA_DOWN ||
+                              GetMType () == LorawanMacHeader::CONFIRMED_DATA_DOWN);
+      }
+    else
+      {
+        m_valid = m_valid && (GetMType () == LorawanMacHeader::UNCONFIRMED_DATA_UP ||
+                              GetMType () == LorawanMacHeader::CONFIRMED_DATA_UP);
+      }
+    return m_valid;
+  }
+
+  bool
+  IsValid (void) const
+  {
+    return m_valid;
+  }
+
+  uint8_t
+  GetMType (void) const
+  {
+    return m_bytes[0] >> 5;
+  }
+
+  bool
+  IsConfirmed (void) const
+  {
+    return GetMType () == LorawanMacHeader::CONFIRMED_DATA_UP;
+  }
+
+  LoraDeviceAddress
+  GetAddress (void) const
+  {
+    return LoraDeviceAddress (uint32_t (m_bytes[1]) | uint32_t (m_bytes[2]) << 8 |
+                              uint32_t (m_bytes[3]) << 16 | uint32_t (m_bytes[4]) << 24);
+  }
+
+  bool
+  GetAdr (void) const
+  {
+    return m_bytes[5] & 0x80;
+  }
+
+  bool
+  GetAck (void) const
+  {
+    return m_bytes[5] & 0x20;
+  }
+
+  uint16_t
+  GetFCnt (void) const
+  {
+    return uint16_t (m_bytes[6] | m_bytes[7] << 8);
+  }
+
+private:
+  uint8_t m_bytes[8];
+  bool m_valid;
+};
+
+} // namespace lorawan
+} // namespace ns3
+
+#endif /* UPLINK_HEADER_VIEW_H */